@@ -7,6 +7,7 @@ import time
 from requests.exceptions import ConnectionError
 from berserk.exceptions import ApiError
 import json
+from datetime import datetime, timedelta, timezone
 
 with open('config.json') as f:
     config = json.load(f)
@@ -34,17 +35,23 @@ class ChessEngineWrapper:
                 
         return history_path, output_path
 
-    def get_engine_move(self, moves):
+    def get_engine_move(self, moves, clock=None):
         # Prepare input/output files
         history_path, output_path = self.prepare_input_file(moves)
         
         try:
             # Call your engine with the correct arguments
-            subprocess.run([
+            args = [
                 self.engine_path,
                 "-H", history_path,
                 "-m", output_path
-            ], check=True)
+            ]
+            # Pass the clock along so the engine can budget its time, without it every move gets a fixed time
+            if clock:
+                for field in ("wtime", "btime", "winc", "binc"):
+                    if field in clock:
+                        args += [f"--{field}", str(to_millis(clock[field]))]
+            subprocess.run(args, check=True)
             
             # Read the engine's move from output file
             with open(output_path, 'r') as f:
@@ -57,6 +64,17 @@ class ChessEngineWrapper:
             os.unlink(history_path)
             os.unlink(output_path)
             
+def to_millis(value):
+    # Depending on the berserk version the clock fields come as ints (ms), timedeltas or datetimes since the epoch
+    if isinstance(value, timedelta):
+        return int(value.total_seconds() * 1000)
+    if isinstance(value, datetime):
+        # Naive ones are UTC (utcfromtimestamp), timestamp() would take them as local time
+        if value.tzinfo is None:
+            value = value.replace(tzinfo=timezone.utc)
+        return int(value.timestamp() * 1000)
+    return int(value)
+            
 def main():
     while True:  # Main reconnection loop
         try:
@@ -91,8 +109,10 @@ def main():
                         for state in client.bots.stream_game_state(game_id):
                             if state['type'] == 'gameFull':
                                 moves = state['state']['moves'].split() if state['state']['moves'] else []
+                                clock = state['state']
                             elif state['type'] == 'gameState':
                                 moves = state['moves'].split() if state['moves'] else []
+                                clock = state
                             
                             is_our_turn = len(moves) % 2 == (0 if bot_is_white else 1)
                             print(f"Moves: {moves}")
@@ -100,7 +120,7 @@ def main():
                             
                             if is_our_turn:
                                 print("Getting engine move...")
-                                engine_move = engine.get_engine_move(moves)
+                                engine_move = engine.get_engine_move(moves, clock)
                                 print(f"Engine suggests: {engine_move}")
                                 
                                 # Retry logic for making moves
@@ -16,8 +16,31 @@ struct bitboard_state {
     bool black_king_side_castle;
     bool black_queen_side_castle;
     U64 en_passant_square;
+    U64 pawn_key;
+    U64 material_key;
 };
 
+// Zobrist keys for the pawns alone, by [color][square], used to cache pawn structure evaluations. Unlike the keys in
+// hash.hpp they are fixed (splitmix64 from a constant seed), so they are ready at compile time
+struct pawn_keys_t {
+    U64 keys[2][64] = {};
+
+    constexpr pawn_keys_t() {
+        U64 state = 0x9e3779b97f4a7c15ULL;
+        for (int color = 0; color < 2; color++) {
+            for (int square = 0; square < 64; square++) {
+                state += 0x9e3779b97f4a7c15ULL;
+                U64 z = state;
+                z     = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z     = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                keys[color][square] = z ^ (z >> 31);
+            }
+        }
+    }
+};
+
+constexpr pawn_keys_t PAWN_KEYS;
+
 struct bitboard_t {
     // LSB represents the square A1, MSB represents H8
 
@@ -53,6 +76,8 @@ struct bitboard_t {
     bool black_king_side_castle;
     bool black_queen_side_castle;
     U64 en_passant_square;
+    U64 pawn_key     = 0; // kept up to date by make_move, see compute_pawn_key()
+    U64 material_key = 0; // piece counts, see material_unit()
 
     bitboard_t() {
         // Initialize all bitboards to 0 (if desired, call initialize_starting_board to set the pieces)
@@ -66,7 +91,10 @@ struct bitboard_t {
         black_queen_side_castle = true;
 
         // Initialize en passant (no target square initially)
-        U64 en_passant_square = 0ULL;
+        en_passant_square = 0ULL;
+
+        // White always moves first, make_move flips this after every move
+        active_color = Color::WHITE;
     }
 
     inline U64 single_bitmask(int square_idx) const { // Pass an index (0-63) and convert to bitmask
@@ -79,7 +107,9 @@ struct bitboard_t {
             white_queen_side_castle,
             black_king_side_castle,
             black_queen_side_castle,
-            en_passant_square};
+            en_passant_square,
+            pawn_key,
+            material_key};
         state_history.push_back(current_state);
     }
 
@@ -96,6 +126,47 @@ struct bitboard_t {
         black_king_side_castle  = previous_state.black_king_side_castle;
         black_queen_side_castle = previous_state.black_queen_side_castle;
         en_passant_square       = previous_state.en_passant_square;
+        pawn_key                = previous_state.pawn_key;
+        material_key            = previous_state.material_key;
+    }
+
+    static U64 pawn_square_key(Color color, int square_idx) {
+        return PAWN_KEYS.keys[color == Color::WHITE ? 0 : 1][square_idx];
+    }
+
+    // From scratch, for setting up a position. make_move updates the key incrementally
+    U64 compute_pawn_key() const {
+        U64 key = 0;
+        for (U64 pawns = board_w_P; pawns; pawns &= pawns - 1) {
+            key ^= pawn_square_key(Color::WHITE, __builtin_ctzll(pawns));
+        }
+        for (U64 pawns = board_b_P; pawns; pawns &= pawns - 1) {
+            key ^= pawn_square_key(Color::BLACK, __builtin_ctzll(pawns));
+        }
+        return key;
+    }
+
+    // The material key holds the count of every piece type but the king in 4 bits each, white's in the lower 20 bits and
+    // black's above. Counts can't go past 10 so it never carries, and equal keys mean equal material
+    static constexpr U64 material_unit(PieceType type, Color color) {
+        return 1ULL << (4 * ((color == Color::WHITE ? 0 : 5) + int(type) - 1));
+    }
+
+    static constexpr int material_count(U64 key, PieceType type, Color color) {
+        return int((key / material_unit(type, color)) & 0xF);
+    }
+
+    U64 compute_material_key() const {
+        return __builtin_popcountll(board_w_P) * material_unit(PieceType::PAWN, Color::WHITE) +
+               __builtin_popcountll(board_w_N) * material_unit(PieceType::KNIGHT, Color::WHITE) +
+               __builtin_popcountll(board_w_B) * material_unit(PieceType::BISHOP, Color::WHITE) +
+               __builtin_popcountll(board_w_R) * material_unit(PieceType::ROOK, Color::WHITE) +
+               __builtin_popcountll(board_w_Q) * material_unit(PieceType::QUEEN, Color::WHITE) +
+               __builtin_popcountll(board_b_P) * material_unit(PieceType::PAWN, Color::BLACK) +
+               __builtin_popcountll(board_b_N) * material_unit(PieceType::KNIGHT, Color::BLACK) +
+               __builtin_popcountll(board_b_B) * material_unit(PieceType::BISHOP, Color::BLACK) +
+               __builtin_popcountll(board_b_R) * material_unit(PieceType::ROOK, Color::BLACK) +
+               __builtin_popcountll(board_b_Q) * material_unit(PieceType::QUEEN, Color::BLACK);
     }
 
     // Just for debugging
@@ -286,6 +357,10 @@ struct bitboard_t {
         board_b_B = 0x2400000000000000ULL;
         board_b_Q = 0x0800000000000000ULL;
         board_b_K = 0x1000000000000000ULL;
+
+        pawn_key     = compute_pawn_key();
+        material_key = compute_material_key();
+        active_color = Color::WHITE;
     }
 
     void initialize_board_from_fen(const string& fen) {
@@ -335,6 +410,8 @@ struct bitboard_t {
             }
             x++;
         }
+        pawn_key     = compute_pawn_key();
+        material_key = compute_material_key();
 
         // Reset castling rights first
         white_king_side_castle  = false;
@@ -4,53 +4,1336 @@
 #include <string.h>
 
 #include "eval.hpp"
+#include "eval_cache.hpp"
 #include "hash.hpp"
 #include "move_t.hpp"
 #include "moves.hpp"
+#include "nnue.hpp"
 #include "piece_t.hpp"
+#include "syzygy.hpp"
+#include "timeman.hpp"
+#include "tt.hpp"
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <thread>
 
-extern chrono::high_resolution_clock::time_point t0;
-extern chrono::high_resolution_clock::time_point t;
-extern long duration;
-const long time_limit = 9500; // In milliseconds, ie 3000ms = 3s
-
-extern bitboard_move_t unique_best_move;
+const long time_limit = 9500; // In milliseconds, ie 3000ms = 3s. Used per move when we are not told the clock
 
 namespace engine {
 constexpr int NEG_INFINITY = -2147483647;
 constexpr int POS_INFINITY = 2147483647;
 
+// Being checkmated at ply p scores -(MATE_SCORE - p) for white, so a quicker mate is worth more. Anything beyond
+// MATE_BOUND is a mate score, not an evaluation.
+constexpr int MATE_SCORE = 1000000;
+
+// Null move pruning: if passing the turn still fails high, a real move will almost certainly do so too
+constexpr int NULL_MOVE_MIN_DEPTH      = 3;
+constexpr int NULL_MOVE_VERIFY_DEPTH   = 1;                 // shallowest verification search worth doing
+constexpr eval::Score NULL_MOVE_VERIFY = eval::ROOK_VALUE; // at or below this much non-pawn material, verify cutoffs
+
+// Late move reductions: quiet moves this far down the ordered list are searched shallower first
+constexpr int LMR_MIN_DEPTH        = 3;
+constexpr int LMR_FULL_MOVES       = 3;    // the first few moves are always searched at full depth
+constexpr int LMR_HISTORY_DIVISOR  = 4096; // one ply less reduction per this much history score
+
+// History tables use gravity: every update pulls the entry toward the bonus by an amount that shrinks as the entry
+// gets close to its maximum, so entries stay within +-max and old results fade without explicit aging
+constexpr int HISTORY_MAX       = 1 << 16;
+constexpr int CONTINUATION_MAX  = 1 << 14; // continuation entries are int16_t
+constexpr int HISTORY_BONUS_MAX = 4096;
+
+constexpr int MAX_PLY      = 128; // deeper than any search we will ever finish, bounds the per ply tables
+constexpr int KILLER_SLOTS = 2;
+constexpr int MATE_BOUND   = MATE_SCORE - MAX_PLY;
+
+// A tablebase win at ply p scores TB_WIN_SCORE - p: better than any evaluation, worse than any mate
+constexpr int TB_WIN_SCORE = MATE_BOUND - MAX_PLY;
+
+// Futility pruning is only trusted this close to the leaves, further up the static eval says too little
+constexpr int FUTILITY_MAX_DEPTH = 3;
+constexpr int RAZOR_MAX_DEPTH    = 2;
+
+// Late move pruning: at this depth or less, quiet moves past a move count that depends on the depth are skipped
+constexpr int LMP_MAX_DEPTH          = 4;
+constexpr int HISTORY_PRUNE_MAX_DEPTH = 3;
+constexpr int NO_EVAL                = NEG_INFINITY; // static eval of a node that did not compute one
+
+// ProbCut: a capture that beats a raised bound in a search this much shallower will almost surely beat the real one
+constexpr int PROBCUT_MIN_DEPTH = 5;
+constexpr int PROBCUT_REDUCTION = 4;
+
+// Captures that lose more than this much material per ply of remaining depth are not searched near the leaves
+constexpr int SEE_PRUNE_DEPTH         = 3;
+constexpr eval::Score SEE_PRUNE_MARGIN = eval::PAWN_VALUE;
+
+// Where the move list is worth a batched evaluation, quiet moves are also ordered by what they gain in material and
+// square value, weighted in history points per centipawn
+constexpr int GAIN_ORDER_MIN_DEPTH = 6; // and at every PV node
+constexpr int GAIN_ORDER_WEIGHT    = 4;
+
+constexpr size_t TT_SIZE_MB         = 64;
+constexpr size_t EVAL_CACHE_SIZE_MB = 4; // per search, --eval-cache-mb changes it
+
+// Default table, used by every search that is not handed one of its own. See tt.hpp for how it stays consistent
+// without locks when several threads share it.
+transposition_table_t tt(TT_SIZE_MB);
+
+// Reading the clock costs about as much as a cheap node, so each thread only does it every so many nodes. Our nodes
+// are slow (legal move generation makes and undoes every move), so this is still well under a millisecond.
+constexpr int TIME_CHECK_INTERVAL = 1024;
+
 struct SearchResult {
     int score;
     int nodes;
 };
 
-SearchResult negamax(bitboard_t& board, int depth, int alpha, int beta, Color color) {
+struct RootResult {
+    bitboard_move_t best_move;
+    int score;
+    int completed_depth; // 0 if not even the first iteration finished
+    long long nodes;
+    vector<bitboard_move_t> pv;
+};
+
+// A move at the root, kept from one iteration to the next. Only the best move gets an exact score, the others failed
+// low and are scored as the worst possible. Sorting by score and then by the size of the subtree puts the best move
+// first and the moves that took the most work to refute, which are the likeliest to become best, right after it.
+struct RootMove {
+    bitboard_move_t move;
+    int score          = 0;
+    int previous_score = 0;
+    long long nodes    = 0; // in the subtree of the last iteration
+    vector<bitboard_move_t> pv;
+};
+
+// Counted per thread, so no thread ever writes another one's statistics
+struct SearchStats {
+    long long nodes                   = 0;
+    long long qsearch_nodes           = 0; // included in nodes
+    long long see_pruned              = 0; // losing captures skipped in the main search and in qsearch
+    long long reverse_futility_pruned = 0; // nodes cut off on their static eval alone
+    long long futility_pruned         = 0; // quiet moves skipped because the static eval is too far below the bound
+    long long razored                 = 0; // nodes resolved by the quiescence search alone
+    long long probcut_cutoffs         = 0;
+    long long late_move_pruned        = 0; // quiet moves skipped for coming too late in the move list
+    long long history_pruned          = 0; // quiet moves skipped for their bad history
+    long long pawn_table_probes       = 0;
+    long long pawn_table_hits         = 0;
+    long long eval_cache_probes       = 0;
+    long long eval_cache_hits         = 0;
+    long long evaluations             = 0; // handcrafted evaluations, not counting cache hits and known endgames
+    long long lazy_evaluations        = 0; // of those, the ones that stopped at the estimate without piece activity
+    long long tb_hits                 = 0; // positions scored by the tablebases
+    long long split_points            = 0; // YBWC nodes whose younger brothers were handed out as tasks
+    long long split_cutoffs           = 0; // of those, the ones where a task failed high
+};
+
+// Pruning margins that are meant to be tuned, so they can be changed at runtime (--param name=value). Margins are in
+// centipawns per ply of remaining depth, on top of the base where there is one.
+struct SearchParams {
+    int reverse_futility_margin = 120;
+    int futility_base           = 80;
+    int futility_margin         = 120;
+    int razor_base              = 300;
+    int razor_margin            = 150;
+    int probcut_margin          = 200; // how far past the bound the shallow search has to get
+    int history_prune_margin    = 2048; // per ply, quiets with a history below minus this are not searched
+    int late_move_pruning       = 1;    // 0 turns off both move count and history pruning, for comparing in bench
+
+    // Returns false for an unknown name
+    bool set(const string& name, int value) {
+        if (name == "reverse_futility_margin") {
+            reverse_futility_margin = value;
+        } else if (name == "futility_base") {
+            futility_base = value;
+        } else if (name == "futility_margin") {
+            futility_margin = value;
+        } else if (name == "razor_base") {
+            razor_base = value;
+        } else if (name == "razor_margin") {
+            razor_margin = value;
+        } else if (name == "probcut_margin") {
+            probcut_margin = value;
+        } else if (name == "history_prune_margin") {
+            history_prune_margin = value;
+        } else if (name == "late_move_pruning") {
+            late_move_pruning = value;
+        } else {
+            return false;
+        }
+        return true;
+    }
+};
+
+inline int color_index(Color color) {
+    return color == Color::WHITE ? 0 : 1;
+}
+
+inline int piece_index(PieceType type) {
+    return int(type) - 1;
+}
+
+inline int history_bonus(int depth) {
+    return min(32 * depth * depth, HISTORY_BONUS_MAX);
+}
+
+template <typename T>
+inline void apply_gravity(T& entry, int bonus, int max_value) {
+    entry += bonus - entry * abs(bonus) / max_value;
+}
+
+// Precomputed log(depth) * log(move index) reductions
+struct lmr_table_t {
+    int reductions[64][MAX_MOVES];
+
+    lmr_table_t() {
+        for (int depth = 0; depth < 64; depth++) {
+            for (int move_idx = 0; move_idx < MAX_MOVES; move_idx++) {
+                reductions[depth][move_idx] = (depth == 0 || move_idx == 0)
+                                                  ? 0
+                                                  : int(0.75 + log(depth) * log(move_idx) / 2.25);
+            }
+        }
+    }
+};
+
+static const lmr_table_t lmr_table;
+
+// Number of moves searched before late move pruning kicks in, indexed by [improving][depth]. When the static eval is
+// worse than two plies ago, the position is going downhill and fewer moves get a chance
+struct lmp_table_t {
+    int move_counts[2][LMP_MAX_DEPTH + 1];
+
+    constexpr lmp_table_t() : move_counts() {
+        for (int depth = 0; depth <= LMP_MAX_DEPTH; depth++) {
+            move_counts[0][depth] = 3 + depth * depth;
+            move_counts[1][depth] = 2 * (3 + depth * depth);
+        }
+    }
+};
+
+constexpr lmp_table_t lmp_table;
+
+// Has to be called before the move is made. Pawns moving to the en passant square are captures too
+inline bool is_capture(const bitboard_t& board, const bitboard_move_t& move, Color color) {
+    return (board.get_all_friendly_pieces(!color) & move.to_board) ||
+           ((move.to_board & board.en_passant_square) && (move.from_board & (board.board_w_P | board.board_b_P)));
+}
+
+inline bool same_move(const bitboard_move_t& a, const bitboard_move_t& b) {
+    return a.from_board == b.from_board && a.to_board == b.to_board && a.promotion_type == b.promotion_type;
+}
+
+// The infinities that open a search window are not mate scores
+inline bool is_mate_score(int score) {
+    return abs(score) >= MATE_BOUND && abs(score) <= MATE_SCORE;
+}
+
+// Mates and tablebase wins, the scores that count plies
+inline bool is_decisive_score(int score) {
+    return abs(score) >= TB_WIN_SCORE - MAX_PLY && abs(score) <= MATE_SCORE;
+}
+
+// Mate and tablebase scores count the plies from the root, but the same position can be reached at any ply and by any
+// thread. The transposition table keeps them counted from the position itself, and they are turned back on the way out
+inline int score_to_tt(int score, int ply) {
+    if (!is_decisive_score(score)) {
+        return score;
+    }
+    return (score > 0) ? score + ply : score - ply;
+}
+
+inline int score_from_tt(int score, int ply) {
+    if (!is_decisive_score(score)) {
+        return score;
+    }
+    return (score > 0) ? score - ply : score + ply;
+}
+
+inline bool gives_check(bitboard_t& board, const bitboard_move_t& move, Color color) {
+    piece_t cap_piece = moves::make_move(board, move);
+    bool check        = moves::is_in_check(board, !color);
+    moves::undo_move(board, move, cap_piece);
+    return check;
+}
+
+// ---- STATIC EXCHANGE EVALUATION ----
+
+// Finds the cheapest piece of the given color among the attackers. Returns EMPTY if there is none
+inline PieceType least_valuable_attacker(const bitboard_t& board, U64 attackers, Color color, U64& attacker_bit) {
+    const U64 pieces[6] = {
+        (color == Color::WHITE) ? board.board_w_P : board.board_b_P,
+        (color == Color::WHITE) ? board.board_w_N : board.board_b_N,
+        (color == Color::WHITE) ? board.board_w_B : board.board_b_B,
+        (color == Color::WHITE) ? board.board_w_R : board.board_b_R,
+        (color == Color::WHITE) ? board.board_w_Q : board.board_b_Q,
+        (color == Color::WHITE) ? board.board_w_K : board.board_b_K,
+    };
+    const PieceType types[6] = {PieceType::PAWN, PieceType::KNIGHT, PieceType::BISHOP,
+                                PieceType::ROOK, PieceType::QUEEN,  PieceType::KING};
+
+    for (int i = 0; i < 6; i++) {
+        if (attackers & pieces[i]) {
+            attacker_bit = (attackers & pieces[i]) & -(attackers & pieces[i]);
+            return types[i];
+        }
+    }
+    return PieceType::EMPTY;
+}
+
+// Material balance of the capture sequence the move starts on its target square, from the mover's point of view.
+// Both sides always recapture with their cheapest piece and may stop whenever continuing would lose material. Pieces
+// are taken off the occupancy as they capture, so sliders lined up behind them join in. Pins are ignored.
+int see(const bitboard_t& board, const bitboard_move_t& move) {
+    int from_idx       = __builtin_ctzll(move.from_board);
+    int to_idx         = __builtin_ctzll(move.to_board);
+    PieceType attacker = board.at(from_idx % 8, from_idx / 8).piece.type;
+    PieceType victim   = board.at(to_idx % 8, to_idx / 8).piece.type;
+    Color color        = (board.get_all_friendly_pieces(Color::WHITE) & move.from_board) ? Color::WHITE : Color::BLACK;
+    U64 occupied       = board.get_all_pieces() ^ move.from_board;
+
+    int gain[32];
+    int d   = 0;
+    gain[0] = eval::get_piece_value(victim);
+    if (attacker == PieceType::PAWN && (move.to_board & board.en_passant_square)) {
+        gain[0] = eval::PAWN_VALUE;
+        occupied ^= (color == Color::WHITE) ? move.to_board >> 8 : move.to_board << 8; // the pawn taken en passant
+    }
+    PieceType on_square = attacker;
+    if (move.promotion_type != PieceType::EMPTY) {
+        gain[0] += eval::get_piece_value(move.promotion_type) - eval::PAWN_VALUE;
+        on_square = move.promotion_type;
+    }
+
+    U64 attackers = moves::attackers_to(board, to_idx, occupied) & occupied;
+    Color side    = !color;
+    while (d < 31) {
+        U64 attacker_bit;
+        PieceType next = least_valuable_attacker(board, attackers, side, attacker_bit);
+        // The king can only take when nothing defends the square anymore
+        if (next == PieceType::EMPTY ||
+            (next == PieceType::KING && (attackers & board.get_all_friendly_pieces(!side)))) {
+            break;
+        }
+
+        d++;
+        gain[d] = eval::get_piece_value(on_square) - gain[d - 1];
+
+        occupied ^= attacker_bit;
+        attackers = moves::attackers_to(board, to_idx, occupied) & occupied;
+        on_square = next;
+        side      = !side;
+    }
+
+    // Walk back up the sequence, each side only captures if that beats stopping there
+    for (; d > 0; d--) {
+        gain[d - 1] = -max(-gain[d - 1], gain[d]);
+    }
+    return gain[0];
+}
+
+// Whether the exchange wins at least the threshold. Most captures are decided by the first two captures alone
+bool see_ge(const bitboard_t& board, const bitboard_move_t& move, int threshold) {
+    int from_idx       = __builtin_ctzll(move.from_board);
+    int to_idx         = __builtin_ctzll(move.to_board);
+    PieceType attacker = board.at(from_idx % 8, from_idx / 8).piece.type;
+    PieceType victim   = board.at(to_idx % 8, to_idx / 8).piece.type;
+
+    if (move.promotion_type == PieceType::EMPTY && victim != PieceType::EMPTY) {
+        if (eval::get_piece_value(victim) < threshold) {
+            return false; // even keeping the capturing piece is not enough
+        }
+        if (eval::get_piece_value(victim) - eval::get_piece_value(attacker) >= threshold) {
+            return true; // even losing the capturing piece is enough
+        }
+    }
+    return see(board, move) >= threshold;
+}
+
+// ---- YOUNG BROTHERS WAIT ----
+
+// Alternative to Lazy SMP. Once the first move of a deep enough node has been searched on its own (the eldest brother),
+// the remaining moves become tasks on the owning thread's deque. The owner works through them from the back, while idle
+// worker threads steal from the front. A cutoff at a split point aborts every subtree still being searched below it.
+enum class ParallelMode {
+    LAZY_SMP,
+    YBWC
+};
+
+constexpr int YBWC_MIN_DEPTH = 4; // shallower nodes are not worth the overhead of sharing
+
+// What the search keeps per ply: the move played from this ply (null for a null move), the piece that made it and the
+// static eval of the node
+struct stack_entry_t {
+    bitboard_move_t move;
+    PieceType piece = PieceType::EMPTY;
+    int static_eval = NO_EVAL;
+};
+
+constexpr int CONTINUATION_PLIES = 2; // continuation histories look this many of our own and the opponent's moves back
+
+struct split_point_t {
+    bitboard_t board; // frozen copy of the position, thieves search from their own copy of this
+    split_point_t* parent;
+    int depth;
+    int ply;
+    Color color;
+    bool in_check;
+    stack_entry_t previous[CONTINUATION_PLIES] = {}; // the owner's stack entries 1 and 2 plies up
+
+    mutex lock; // guards everything below
+    int alpha                   = 0;
+    int beta                    = 0;
+    int best_score              = 0;
+    bitboard_move_t best_move   = {};
+    bitboard_move_t cutoff_move = {};
+    bool cutoff_is_quiet        = false;
+    bitboard_move_t quiets_searched[MAX_MOVES]; // quiet moves that finished without a cutoff, for the history malus
+    int quiet_count = 0;
+
+    atomic<bool> cutoff{false};
+    atomic<int> pending{0}; // tasks that have not finished yet, the split point lives until this reaches 0
+
+    split_point_t(const bitboard_t& board, split_point_t* parent, int depth, int ply, Color color, bool in_check)
+        : board(board), parent(parent), depth(depth), ply(ply), color(color), in_check(in_check) {}
+};
+
+struct task_t {
+    split_point_t* split_point;
+    bitboard_move_t move;
+    int move_idx;
+    bool is_quiet;
+};
+
+struct task_deque_t {
+    mutex lock;
+    deque<task_t> tasks;
+};
+
+// ---- SEARCH STATE ----
+
+class Searcher;
+
+// Everything the threads of one search share: the clock and its limits, the stop flag, the transposition table and the
+// helper threads. Nothing in here is global, so separate contexts can search separate games in the same process. A
+// context is meant for a single search, the stop flag is never lowered again.
+struct SearchContext {
+    transposition_table_t& tt;
+    chrono::high_resolution_clock::time_point start_time;
+    timeman::time_manager_t time_manager = {false, time_limit, time_limit}; // switch to init() when there is a clock
+    ParallelMode parallel_mode            = ParallelMode::LAZY_SMP;
+    SearchParams params;
+    const nnue::network_t* network = nullptr; // evaluate with this instead of eval::evaluate_position when set
+    eval_cache_t eval_cache{EVAL_CACHE_SIZE_MB};
+    syzygy::tablebases_t* tablebases = nullptr; // probed at the root and in the search when set
+
+    // Set once the search has to stop, either because time ran out or because the main thread is done. Every thread
+    // polls it at every node, so raising it unwinds all searches within a few nodes.
+    atomic<bool> stop{false};
+
+    vector<unique_ptr<task_deque_t>> task_deques; // YBWC only, index 0 belongs to the main thread
+    vector<unique_ptr<Searcher>> helpers;
+    vector<thread> helper_threads;
+
+    explicit SearchContext(transposition_table_t& table                 = engine::tt,
+                           chrono::high_resolution_clock::time_point start = chrono::high_resolution_clock::now());
+    ~SearchContext();
+
+    long elapsed_ms() const {
+        return chrono::duration_cast<chrono::milliseconds>(chrono::high_resolution_clock::now() - start_time).count();
+    }
+
+    void start_helper_threads(const bitboard_t& board, Color color, int count);
+    void stop_helper_threads();
+    void print_search_report(const Searcher& main_searcher) const;
+};
+
+// The part of a search that belongs to a single thread: move ordering tables, statistics and, for the main thread, the
+// result. Helper threads get a searcher of their own on the same context.
+class Searcher {
+  public:
+    SearchContext& context;
+    SearchStats stats;
+    RootResult result = {};
+
+    explicit Searcher(SearchContext& search_context, int thread_id = 0)
+        : context(search_context), thread_idx(thread_id) {
+        for (auto& table : continuation_history) {
+            table = make_unique<continuation_table_t>();
+        }
+        if (context.network) {
+            accumulators = make_unique<accumulator_entry_t[]>(MAX_PLY + 1);
+        }
+    }
+
+    RootResult search(bitboard_t& board, Color color);
+    pair<bitboard_move_t, SearchResult> get_best_move(bitboard_t& board, int depth, Color color);
+    SearchResult negamax(bitboard_t& board, int depth, int alpha, int beta, Color color, int ply = 0,
+                         bool allow_null = true);
+    SearchResult qsearch(bitboard_t& board, int alpha, int beta, Color color, int ply);
+    const vector<RootMove>& ordered_root_moves() const { return root_moves; }
+
+    void helper_search(bitboard_t board, Color color);
+    void worker_loop();
+    int thread_id() const { return thread_idx; }
+
+  private:
+    friend struct SearcherInspector;
+
+    int thread_idx; // 0 for the main thread
+    int nodes_until_time_check = TIME_CHECK_INTERVAL;
+
+    // Butterfly history, indexed by [color][from][to]. Quiet moves that caused a beta cutoff get a bonus, so they are
+    // tried earlier (and reduced less) the next time they show up, the quiet moves that failed before them a malus
+    int history_table[2][64][64] = {};
+
+    // Continuation histories, the same bonuses but indexed by the move 1 or 2 plies back as well:
+    // [color][previous piece][previous to][piece][to]. Too big for the stack, so they live on the heap
+    struct continuation_table_t {
+        int16_t entries[2][6][64][6][64] = {};
+    };
+    unique_ptr<continuation_table_t> continuation_history[CONTINUATION_PLIES];
+
+    // The quiet move that refuted the opponent's last move, indexed by [color][piece][to] of that move
+    bitboard_move_t counter_moves[2][6][64] = {};
+
+    // Quiet moves that caused a beta cutoff at the same ply, most recent first
+    bitboard_move_t killers[MAX_PLY][KILLER_SLOTS] = {};
+
+    stack_entry_t search_stack[MAX_PLY];
+
+    split_point_t* active_split_point = nullptr; // innermost split point this thread is working for
+
+    // NNUE accumulators by ply, only allocated when the context has a network. Making a move records the inputs it
+    // changed and marks the child's accumulator as stale, the evaluation then brings it up to date from the closest
+    // ancestor that is not. Ply 0 is never trusted, as the root changes between searches without us making a move.
+    struct accumulator_entry_t {
+        nnue::accumulator_t accumulator;
+        nnue::feature_delta_t delta;
+        bool computed = false;
+    };
+    unique_ptr<accumulator_entry_t[]> accumulators;
+
+    eval::pawn_table_t pawn_table;
+    eval::material_table_t material_table;
+
+    // Root moves in the order of the last completed iteration, for the position with the given hash
+    vector<RootMove> root_moves;
+    U64 root_hash = 0;
+
+    bool time_is_up();
+    int evaluate(const bitboard_t& board, int ply, U64 hash_key, int alpha, int beta);
+    int static_evaluation(const bitboard_t& board, int ply, eval::eval_window_t* window);
+    piece_t make_move(bitboard_t& board, const bitboard_move_t& move, int ply);
+    void make_null_move(bitboard_t& board, int ply);
+    void invalidate_accumulators();
+    bool split_point_aborted() const;
+    bool search_aborted() const;
+    int quiet_history(const bitboard_move_t& move, PieceType piece, Color color, int ply) const;
+    void update_quiet_histories(const bitboard_move_t& move, PieceType piece, Color color, int ply, int bonus);
+    void update_cutoff_move(const bitboard_t& board, const bitboard_move_t& move, Color color, int ply, int depth);
+    void penalize_quiets(const bitboard_t& board, const bitboard_move_t* quiets, int count, Color color, int ply,
+                         int depth);
+    void update_killers(const bitboard_move_t& move, int ply);
+    void order_moves(const bitboard_t& board, move_list_t& move_list, Color color, int ply,
+                     const bitboard_move_t& hash_move = {}, bool order_by_gain = false) const;
+    void init_root_moves(bitboard_t& board, Color color);
+    vector<bitboard_move_t> extract_pv(bitboard_t& board, const bitboard_move_t& move, Color color, int max_length);
+    bool prune_move(bitboard_t& board, const bitboard_move_t& move, int move_idx, bool is_quiet, int depth, int ply,
+                    Color color, bool in_check, bool futile, bool late_move_pruning, bool improving);
+    SearchResult search_move(bitboard_t& board, const bitboard_move_t& move, int move_idx, bool is_quiet, int depth,
+                             int ply, int alpha, int beta, Color color, bool in_check);
+    int execute_task(const task_t& task, bitboard_t& board);
+    bool pop_own_task(split_point_t* split_point, task_t& task);
+    bool steal_task(task_t& task);
+    bool steal_task_below(const split_point_t* split_point, task_t& task);
+};
+
+// Call once per node
+bool Searcher::time_is_up() {
+    if (--nodes_until_time_check <= 0) {
+        nodes_until_time_check = TIME_CHECK_INTERVAL;
+        if (context.elapsed_ms() > context.time_manager.maximum_ms) {
+            context.stop.store(true, memory_order_relaxed);
+        }
+    }
+    return context.stop.load(memory_order_relaxed);
+}
+
+// Static evaluation of the position at the given ply, from white's perspective. Looked up in the evaluation cache
+// first, the key is only used for that
+int Searcher::evaluate(const bitboard_t& board, int ply, U64 hash_key, int alpha, int beta) {
+    eval::eval_window_t window{alpha, beta};
+    if (!context.eval_cache.enabled()) {
+        return static_evaluation(board, ply, &window);
+    }
+
+    int score;
+    stats.eval_cache_probes++;
+    if (context.eval_cache.probe(hash_key, score)) {
+        stats.eval_cache_hits++;
+        return score;
+    }
+    score = static_evaluation(board, ply, &window);
+    // a lazy estimate is only good enough for this window, other nodes may need the exact score
+    if (!window.lazy_exit) {
+        context.eval_cache.store(hash_key, score);
+    }
+    return score;
+}
+
+int Searcher::static_evaluation(const bitboard_t& board, int ply, eval::eval_window_t* window) {
+    eval::material_entry_t& material = material_table.slot(board.material_key);
+    if (material.key != board.material_key) {
+        material = eval::evaluate_material(board.material_key);
+    }
+    // known endgames are scored by their own rules, with or without the network
+    if (material.endgame) {
+        return material.endgame(board, material.strong);
+    }
+
+    const nnue::network_t* network = context.network;
+    if (!network) {
+        eval::pawn_entry_t& pawns = pawn_table.slot(board.pawn_key);
+        stats.pawn_table_probes++;
+        if (pawns.key == board.pawn_key) {
+            stats.pawn_table_hits++;
+        } else {
+            pawns = eval::evaluate_pawns(board);
+        }
+        stats.evaluations++;
+        int score = eval::evaluate_position(board, &pawns, &material, window);
+        stats.lazy_evaluations += window->lazy_exit;
+        return score;
+    }
+    if (ply > MAX_PLY) {
+        nnue::accumulator_t accumulator;
+        network->refresh(board, accumulator);
+        return network->evaluate(accumulator);
+    }
+
+    int computed = ply;
+    while (computed > 0 && !accumulators[computed].computed) {
+        computed--;
+    }
+    if (computed == 0) {
+        network->refresh(board, accumulators[ply].accumulator);
+    } else {
+        for (int next = computed + 1; next <= ply; next++) {
+            network->update(accumulators[next - 1].accumulator, accumulators[next].delta, accumulators[next].accumulator);
+        }
+    }
+    accumulators[ply].computed = true;
+    return network->evaluate(accumulators[ply].accumulator);
+}
+
+// Every move the search makes from a node at the given ply goes through here, so the accumulators stay in sync
+piece_t Searcher::make_move(bitboard_t& board, const bitboard_move_t& move, int ply) {
+    piece_t cap_piece = moves::make_move(board, move);
+    if (accumulators && ply < MAX_PLY) {
+        accumulators[ply + 1].delta    = nnue::move_delta(board, move, cap_piece);
+        accumulators[ply + 1].computed = false;
+    }
+    return cap_piece;
+}
+
+void Searcher::make_null_move(bitboard_t& board, int ply) {
+    moves::make_null_move(board);
+    if (accumulators && ply < MAX_PLY) {
+        accumulators[ply + 1].delta    = {};
+        accumulators[ply + 1].computed = false;
+    }
+}
+
+// For when the board was not reached through our own make_move calls, ie. a YBWC task
+void Searcher::invalidate_accumulators() {
+    for (int ply = 0; accumulators && ply <= MAX_PLY; ply++) {
+        accumulators[ply].computed = false;
+    }
+}
+
+// Butterfly plus continuation history, the score quiet moves are ordered, reduced and pruned by
+int Searcher::quiet_history(const bitboard_move_t& move, PieceType piece, Color color, int ply) const {
+    int to_idx = __builtin_ctzll(move.to_board);
+    int score  = history_table[color_index(color)][__builtin_ctzll(move.from_board)][to_idx];
+
+    for (int back = 1; back <= CONTINUATION_PLIES && back <= ply && ply - back < MAX_PLY; back++) {
+        const stack_entry_t& previous = search_stack[ply - back];
+        if (previous.piece != PieceType::EMPTY) {
+            score += continuation_history[back - 1]->entries[color_index(color)][piece_index(previous.piece)]
+                                                            [__builtin_ctzll(previous.move.to_board)][piece_index(piece)][to_idx];
+        }
+    }
+    return score;
+}
+
+// Cutoffs earn a positive bonus, quiet moves searched before the cutoff move a negative one
+void Searcher::update_quiet_histories(const bitboard_move_t& move, PieceType piece, Color color, int ply, int bonus) {
+    int to_idx = __builtin_ctzll(move.to_board);
+    apply_gravity(history_table[color_index(color)][__builtin_ctzll(move.from_board)][to_idx], bonus, HISTORY_MAX);
+
+    for (int back = 1; back <= CONTINUATION_PLIES && back <= ply && ply - back < MAX_PLY; back++) {
+        const stack_entry_t& previous = search_stack[ply - back];
+        if (previous.piece != PieceType::EMPTY) {
+            apply_gravity(continuation_history[back - 1]->entries[color_index(color)][piece_index(previous.piece)]
+                                                                 [__builtin_ctzll(previous.move.to_board)][piece_index(piece)][to_idx],
+                          bonus, CONTINUATION_MAX);
+        }
+    }
+}
+
+// A quiet move caused a beta cutoff: it becomes a killer and the counter move to the opponent's last move
+void Searcher::update_cutoff_move(const bitboard_t& board, const bitboard_move_t& move, Color color, int ply,
+                                  int depth) {
+    int from_idx = __builtin_ctzll(move.from_board);
+    update_quiet_histories(move, board.at(from_idx % 8, from_idx / 8).piece.type, color, ply, history_bonus(depth));
+    update_killers(move, ply);
+
+    if (ply >= 1 && ply - 1 < MAX_PLY && search_stack[ply - 1].piece != PieceType::EMPTY) {
+        const stack_entry_t& previous = search_stack[ply - 1];
+        counter_moves[color_index(color)][piece_index(previous.piece)][__builtin_ctzll(previous.move.to_board)] = move;
+    }
+}
+
+// The quiet moves searched before the one that caused the cutoff get the opposite of its bonus
+void Searcher::penalize_quiets(const bitboard_t& board, const bitboard_move_t* quiets, int count, Color color, int ply,
+                               int depth) {
+    for (int i = 0; i < count; i++) {
+        int from_idx = __builtin_ctzll(quiets[i].from_board);
+        update_quiet_histories(quiets[i], board.at(from_idx % 8, from_idx / 8).piece.type, color, ply,
+                               -history_bonus(depth));
+    }
+}
+
+void Searcher::update_killers(const bitboard_move_t& move, int ply) {
+    if (ply >= MAX_PLY || same_move(move, killers[ply][0])) {
+        return;
+    }
+    for (int slot = KILLER_SLOTS - 1; slot > 0; slot--) {
+        killers[ply][slot] = killers[ply][slot - 1];
+    }
+    killers[ply][0] = move;
+}
+
+// The hash move first, then captures that do not lose material (most valuable victim, least valuable attacker), then
+// promotions, then the killers, the counter move and the remaining quiet moves by history (plus their gain in material
+// and square value where asked for), and the losing captures last.
+// Quiet history can add up to about 2 * HISTORY_MAX, the other groups are spaced far enough apart to stay clear of it
+
+void Searcher::order_moves(const bitboard_t& board, move_list_t& move_list, Color color, int ply,
+                           const bitboard_move_t& hash_move, bool order_by_gain) const {
+    int scores[MAX_MOVES];
+    eval::Score gains[MAX_MOVES];
+    if (order_by_gain) {
+        eval::move_batch_t batch;
+        eval::prepare_move_batch(board, move_list, color, batch);
+        eval::move_gains(batch, eval::game_phase(board), gains);
+    }
+
+    bitboard_move_t counter_move;
+    if (ply >= 1 && ply - 1 < MAX_PLY && search_stack[ply - 1].piece != PieceType::EMPTY) {
+        const stack_entry_t& previous = search_stack[ply - 1];
+        counter_move = counter_moves[color_index(color)][piece_index(previous.piece)][__builtin_ctzll(previous.move.to_board)];
+    }
+
+    for (int i = 0; i < move_list.count; i++) {
+        const bitboard_move_t& move = move_list.moves[i];
+        int from_idx                = __builtin_ctzll(move.from_board);
+        int to_idx                  = __builtin_ctzll(move.to_board);
+
+        if (same_move(move, hash_move)) {
+            scores[i] = 8 * HISTORY_MAX;
+        } else if (is_capture(board, move, color)) {
+            PieceType victim   = board.at(to_idx % 8, to_idx / 8).piece.type;
+            PieceType attacker = board.at(from_idx % 8, from_idx / 8).piece.type;
+            int victim_value   = (victim == PieceType::EMPTY) ? eval::PAWN_VALUE : eval::get_piece_value(victim); // en passant
+            int mvv_lva        = victim_value * 16 - eval::get_piece_value(attacker) / 16;
+            // Captures that lose material in the exchange go after the quiet moves
+            scores[i] = see_ge(board, move, 0) ? 6 * HISTORY_MAX + mvv_lva : -6 * HISTORY_MAX + mvv_lva;
+        } else if (move.promotion_type != PieceType::EMPTY) {
+            scores[i] = 6 * HISTORY_MAX + eval::get_piece_value(move.promotion_type);
+        } else {
+            PieceType piece = board.at(from_idx % 8, from_idx / 8).piece.type;
+            scores[i]       = quiet_history(move, piece, color, ply) + (order_by_gain ? gains[i] * GAIN_ORDER_WEIGHT : 0);
+            if (same_move(move, counter_move)) {
+                scores[i] = 4 * HISTORY_MAX;
+            }
+            for (int slot = 0; ply < MAX_PLY && slot < KILLER_SLOTS; slot++) {
+                if (same_move(move, killers[ply][slot])) {
+                    scores[i] = 4 * HISTORY_MAX + KILLER_SLOTS - slot;
+                }
+            }
+        }
+    }
+
+    // Insertion sort, the lists are short and it keeps the generator order between equal scores
+    for (int i = 1; i < move_list.count; i++) {
+        bitboard_move_t move = move_list.moves[i];
+        int score            = scores[i];
+        int j                = i - 1;
+        while (j >= 0 && scores[j] < score) {
+            move_list.moves[j + 1] = move_list.moves[j];
+            scores[j + 1]          = scores[j];
+            j--;
+        }
+        move_list.moves[j + 1] = move;
+        scores[j + 1]          = score;
+    }
+}
+
+// Per-move pruning near the leaves, decided before the move is made. The first move is never pruned, so there is always
+// a real score to return. The node decides once whether futility and late move pruning apply at all.
+bool Searcher::prune_move(bitboard_t& board, const bitboard_move_t& move, int move_idx, bool is_quiet, int depth,
+                          int ply, Color color, bool in_check, bool futile, bool late_move_pruning, bool improving) {
+    if (move_idx == 0) {
+        return false;
+    }
+
+    if (futile && is_quiet && !gives_check(board, move, color)) {
+        stats.futility_pruned++;
+        return true;
+    }
+
+    // Late quiet moves near the leaves hardly ever raise the bound, neither do quiet moves that keep failing
+    if (late_move_pruning && is_quiet) {
+        if (move_idx >= lmp_table.move_counts[improving][depth]) {
+            stats.late_move_pruned++;
+            return true;
+        }
+        int from_idx = __builtin_ctzll(move.from_board);
+        int history  = quiet_history(move, board.at(from_idx % 8, from_idx / 8).piece.type, color, ply);
+        if (depth <= HISTORY_PRUNE_MAX_DEPTH && history < -context.params.history_prune_margin * depth) {
+            stats.history_pruned++;
+            return true;
+        }
+    }
+
+    // Captures that clearly lose material
+    if (!is_quiet && !in_check && depth <= SEE_PRUNE_DEPTH && !see_ge(board, move, -SEE_PRUNE_MARGIN * depth)) {
+        stats.see_pruned++;
+        return true;
+    }
+    return false;
+}
+
+// Searches one child of the current node, with a reduced null window first if the move qualifies for LMR. The board is
+// left as it was found.
+SearchResult Searcher::search_move(bitboard_t& board, const bitboard_move_t& move, int move_idx, bool is_quiet,
+                                   int depth, int ply, int alpha, int beta, Color color, bool in_check) {
+    int nodes       = 0;
+    int from_idx    = __builtin_ctzll(move.from_board);
+    PieceType piece = board.at(from_idx % 8, from_idx / 8).piece.type;
+    if (ply < MAX_PLY) {
+        search_stack[ply].move  = move;
+        search_stack[ply].piece = piece;
+    }
+    piece_t cap_piece = make_move(board, move, ply);
+
+    // Late move reduction. Checks are excluded as they are often forcing, even when quiet
+    int reduction = 0;
+    if (depth >= LMR_MIN_DEPTH && move_idx >= LMR_FULL_MOVES && is_quiet && !in_check && !moves::is_in_check(board, !color)) {
+        int history = quiet_history(move, piece, color, ply);
+        reduction   = lmr_table.reductions[min(depth, 63)][min(move_idx, MAX_MOVES - 1)] - history / LMR_HISTORY_DIVISOR;
+        reduction   = clamp(reduction, 0, depth - 2);
+    }
+
+    SearchResult result;
+    if (reduction > 0) {
+        // Null window search at reduced depth, only if it might raise our bound do we pay for the full search
+        int null_alpha = (color == Color::WHITE) ? alpha : beta - 1;
+        int null_beta  = (color == Color::WHITE) ? alpha + 1 : beta;
+        result         = negamax(board, depth - 1 - reduction, null_alpha, null_beta, !color, ply + 1);
+        nodes += result.nodes;
+
+        bool raises_bound = (color == Color::WHITE) ? result.score > alpha : result.score < beta;
+        if (raises_bound) {
+            result = negamax(board, depth - 1, alpha, beta, !color, ply + 1);
+            nodes += result.nodes;
+        }
+    } else {
+        result = negamax(board, depth - 1, alpha, beta, !color, ply + 1);
+        nodes += result.nodes;
+    }
+
+    moves::undo_move(board, move, cap_piece);
+    return {result.score, nodes};
+}
+
+// True if the split point we are working for, or any split point above it, already had a cutoff
+bool Searcher::split_point_aborted() const {
+    for (split_point_t* split_point = active_split_point; split_point; split_point = split_point->parent) {
+        if (split_point->cutoff.load(memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// An aborted search returns whatever it had when it noticed, which is meaningless. Callers check this right after
+// every child search and throw the result away instead of letting it reach a bound, a best move or the table.
+bool Searcher::search_aborted() const {
+    return context.stop.load(memory_order_relaxed) || split_point_aborted();
+}
+
+// Searches the task's move on the given board (a copy of the split point's position) and merges the result. Returns
+// the number of nodes searched, which the executing thread keeps in its own count.
+int Searcher::execute_task(const task_t& task, bitboard_t& board) {
+    split_point_t* split_point = task.split_point;
+    SearchResult result        = {0, 0};
+
+    split_point_t* previous_split_point = active_split_point;
+    active_split_point                  = split_point;
+    for (int back = 1; back <= CONTINUATION_PLIES && back <= split_point->ply; back++) {
+        search_stack[split_point->ply - back] = split_point->previous[back - 1];
+    }
+    invalidate_accumulators(); // the task's board and the one we may have been searching share no history
+
+    if (!search_aborted()) {
+        int alpha, beta;
+        {
+            lock_guard<mutex> guard(split_point->lock);
+            alpha = split_point->alpha;
+            beta  = split_point->beta;
+        }
+        result = search_move(board, task.move, task.move_idx, task.is_quiet, split_point->depth, split_point->ply,
+                             alpha, beta, split_point->color, split_point->in_check);
+
+        if (!search_aborted()) {
+            lock_guard<mutex> guard(split_point->lock);
+            Color color = split_point->color;
+            if ((color == Color::WHITE && result.score > split_point->best_score) ||
+                (color == Color::BLACK && result.score < split_point->best_score)) {
+                split_point->best_score = result.score;
+                split_point->best_move  = task.move;
+            }
+            if (color == Color::WHITE) {
+                split_point->alpha = max(split_point->alpha, result.score);
+            } else {
+                split_point->beta = min(split_point->beta, result.score);
+            }
+            if (split_point->alpha >= split_point->beta && !split_point->cutoff) {
+                split_point->cutoff_move     = task.move;
+                split_point->cutoff_is_quiet = task.is_quiet;
+                split_point->cutoff          = true;
+            } else if (task.is_quiet) {
+                split_point->quiets_searched[split_point->quiet_count++] = task.move;
+            }
+        }
+    }
+
+    active_split_point = previous_split_point;
+    invalidate_accumulators();
+    split_point->pending.fetch_sub(1); // must be the last access, the owner may return as soon as this hits 0
+    return result.nodes;
+}
+
+// The owner only takes back tasks of its own split point. They sit at the back of its deque, above any tasks of split
+// points further up the tree.
+bool Searcher::pop_own_task(split_point_t* split_point, task_t& task) {
+    task_deque_t& own = *context.task_deques[thread_idx];
+    lock_guard<mutex> guard(own.lock);
+    if (own.tasks.empty() || own.tasks.back().split_point != split_point) {
+        return false;
+    }
+    task = own.tasks.back();
+    own.tasks.pop_back();
+    return true;
+}
+
+// Thieves take the oldest task of another thread, which tends to be the one highest up in the tree
+bool Searcher::steal_task(task_t& task) {
+    auto& deques = context.task_deques;
+    for (size_t i = 1; i <= deques.size(); i++) {
+        task_deque_t& victim = *deques[(thread_idx + i) % deques.size()];
+        lock_guard<mutex> guard(victim.lock);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+SearchResult Searcher::negamax(bitboard_t& board, int depth, int alpha, int beta, Color color, int ply,
+                               bool allow_null) {
+
+    // Testing the time, and whether another thread already made this subtree irrelevant
+    if (time_is_up() || split_point_aborted()) {
+        return {(color == Color::WHITE) ? NEG_INFINITY : POS_INFINITY, 1};
+    }
+
+    // If we can repeat an earlier position we score at least a draw, which may already be enough for a cutoff
+    if (ply > 0 && (color == Color::WHITE ? alpha < 0 : beta > 0) && hash_t::has_upcoming_repetition(board, ply)) {
+        if (color == Color::WHITE) {
+            alpha = 0;
+        } else {
+            beta = 0;
+        }
+        if (alpha >= beta) {
+            return {0, 1};
+        }
+    }
 
     if (depth == 0) {
-        return {eval::evaluate_position(board), 1};
+        return qsearch(board, alpha, beta, color, ply);
     }
     // Threefold rep
     if (hash_t::is_threefold_repetition(board)) {
         return {0, 1};
     }
 
+    // Transposition table lookup, another thread (or an earlier iteration) may have searched this position already
+    U64 hash_key = hash_t::compute_hash(board);
+    tt_entry_t tt_entry;
+    bitboard_move_t hash_move;
+    if (context.tt.probe(hash_key, tt_entry)) {
+        hash_move      = tt_entry.best_move;
+        tt_entry.score = score_from_tt(tt_entry.score, ply);
+        if (tt_entry.depth >= depth) {
+            if (tt_entry.bound == Bound::EXACT ||
+                (tt_entry.bound == Bound::LOWER && tt_entry.score >= beta) ||
+                (tt_entry.bound == Bound::UPPER && tt_entry.score <= alpha)) {
+                return {tt_entry.score, 1};
+            }
+        }
+    }
+
+    // Positions in the tablebases have an exact result. Cursed wins and blessed losses are draws by the fifty move rule
+    if (ply > 0 && context.tablebases != nullptr && context.tablebases->can_probe(board)) {
+        syzygy::probe_state_t state;
+        syzygy::wdl_t wdl = context.tablebases->probe_wdl(board, state);
+        if (state != syzygy::FAIL) {
+            stats.tb_hits++;
+            int score = (wdl == syzygy::WIN) ? TB_WIN_SCORE - ply : (wdl == syzygy::LOSS) ? -(TB_WIN_SCORE - ply) : 0;
+            score     = (color == Color::WHITE) ? score : -score;
+            context.tt.store(hash_key, {score_to_tt(score, ply), depth, Bound::EXACT, bitboard_move_t{}});
+            return {score, 1};
+        }
+    }
+
     move_list_t possible_moves = moves::generate_all_moves_for_color(board, color);
     int nodes                  = 1;
     int best_score             = (color == Color::WHITE) ? NEG_INFINITY : POS_INFINITY;
+    bitboard_move_t best_move;
+    int original_alpha = alpha;
+    int original_beta  = beta;
+
+    bool in_check = moves::is_in_check(board, color);
+
+    if (possible_moves.count == 0) {
+        int mated_score = (color == Color::WHITE) ? -(MATE_SCORE - ply) : MATE_SCORE - ply;
+        return {in_check ? mated_score : 0, 1}; // checkmate or stalemate
+    }
+
+    // The static eval feeds the pruning below, none of which is done in check or when mate scores are in play
+    const SearchParams& params = context.params;
+    bool can_prune             = !in_check && !is_mate_score(alpha) && !is_mate_score(beta);
+    int static_eval            = can_prune ? evaluate(board, ply, hash_key, alpha, beta) : 0;
+
+    // Reverse futility: so far above the bound we are trying to beat that no move of the opponent will bring us back
+    if (can_prune && depth <= FUTILITY_MAX_DEPTH) {
+        int margin = params.reverse_futility_margin * depth;
+        if ((color == Color::WHITE && static_eval - margin >= beta) ||
+            (color == Color::BLACK && static_eval + margin <= alpha)) {
+            stats.reverse_futility_pruned++;
+            return {static_eval, nodes};
+        }
+    }
+
+    // Razoring: far enough below our bound that only captures could save us, so let the quiescence search decide. If
+    // it fails to reach the bound as well, we trust it
+    if (can_prune && depth <= RAZOR_MAX_DEPTH) {
+        int margin = params.razor_base + params.razor_margin * depth;
+        if (color == Color::WHITE && static_eval + margin <= alpha) {
+            SearchResult result = qsearch(board, alpha, alpha + 1, color, ply);
+            nodes += result.nodes;
+            if (!search_aborted() && result.score <= alpha) {
+                stats.razored++;
+                return {result.score, nodes};
+            }
+        } else if (color == Color::BLACK && static_eval - margin >= beta) {
+            SearchResult result = qsearch(board, beta - 1, beta, color, ply);
+            nodes += result.nodes;
+            if (!search_aborted() && result.score >= beta) {
+                stats.razored++;
+                return {result.score, nodes};
+            }
+        }
+    }
+
+    // Forward futility: so far below our bound that a quiet move will not get us there, only captures, promotions
+    // and checks are searched
+    bool futile = false;
+    if (can_prune && depth <= FUTILITY_MAX_DEPTH) {
+        int margin = params.futility_base + params.futility_margin * depth;
+        futile     = (color == Color::WHITE) ? static_eval + margin <= alpha : static_eval - margin >= beta;
+    }
+
+    // Improving: our static eval is better than at our previous turn. Without both evals we assume it is, which only
+    // makes the late move pruning below more careful
+    if (ply < MAX_PLY) {
+        search_stack[ply].static_eval = can_prune ? static_eval : NO_EVAL;
+    }
+    bool improving = true;
+    if (can_prune && ply >= 2 && ply < MAX_PLY && search_stack[ply - 2].static_eval != NO_EVAL) {
+        int previous_eval = search_stack[ply - 2].static_eval;
+        improving         = (color == Color::WHITE) ? static_eval > previous_eval : static_eval < previous_eval;
+    }
+    bool late_move_pruning = can_prune && params.late_move_pruning && depth <= LMP_MAX_DEPTH;
+    bitboard_move_t quiets_searched[MAX_MOVES];
+    int quiet_count = 0;
 
-    // Testing the time
-    t        = chrono::high_resolution_clock::now();
-    duration = chrono::duration_cast<chrono::milliseconds>(t - t0).count();
-    if (duration > time_limit) {
-        return {best_score, nodes};
-    }   
+    // Null move pruning. Skipped in check (passing would be illegal) and without pieces, where zugzwang is common
+    eval::Score material = eval::non_pawn_material(board, color);
+    if (allow_null && depth >= NULL_MOVE_MIN_DEPTH && material > 0 && can_prune) {
+        // Null window around the bound we are trying to beat: beta for white, alpha for black
+        int null_alpha = (color == Color::WHITE) ? beta - 1 : alpha;
+        int null_beta  = (color == Color::WHITE) ? beta : alpha + 1;
+
+        if ((color == Color::WHITE && static_eval >= beta) || (color == Color::BLACK && static_eval <= alpha)) {
+            int reduction = (depth > 6) ? 3 : 2; // adaptive null move, reduce more when far from the leaves
+
+            if (ply < MAX_PLY) {
+                search_stack[ply].move  = {};
+                search_stack[ply].piece = PieceType::EMPTY; // nothing to continue from
+            }
+            make_null_move(board, ply);
+            SearchResult null_result =
+                negamax(board, max(depth - 1 - reduction, 0), null_alpha, null_beta, !color, ply + 1, false);
+            moves::undo_null_move(board);
+            nodes += null_result.nodes;
+            if (search_aborted()) {
+                return {best_score, nodes};
+            }
+
+            bool fails_high = (color == Color::WHITE) ? null_result.score >= beta : null_result.score <= alpha;
+            if (fails_high && material <= NULL_MOVE_VERIFY) {
+                // Few pieces left, so zugzwang is a real danger. Verify with a reduced search where we do have to move
+                int verify_depth = max(depth - reduction, NULL_MOVE_VERIFY_DEPTH);
+                SearchResult verify_result = negamax(board, verify_depth, null_alpha, null_beta, color, ply, false);
+                nodes += verify_result.nodes;
+                if (search_aborted()) {
+                    return {best_score, nodes};
+                }
+                fails_high = (color == Color::WHITE) ? verify_result.score >= beta : verify_result.score <= alpha;
+            }
+            if (fails_high) {
+                return {(color == Color::WHITE) ? beta : alpha, nodes};
+            }
+        }
+    }
+
+    // ProbCut. Only captures that win enough material by SEE are tried, first in qsearch and then at reduced depth,
+    // both against the raised bound. Not against an infinite or a mate bound, raising those means nothing (or overflows)
+    int cut_bound = (color == Color::WHITE) ? beta : alpha;
+    if (can_prune && depth >= PROBCUT_MIN_DEPTH && abs(cut_bound) < MATE_BOUND) {
+        int probcut_bound  = (color == Color::WHITE) ? beta + params.probcut_margin : alpha - params.probcut_margin;
+        int probcut_alpha  = (color == Color::WHITE) ? probcut_bound - 1 : probcut_bound;
+        int probcut_beta   = (color == Color::WHITE) ? probcut_bound : probcut_bound + 1;
+        int see_threshold  = (color == Color::WHITE) ? probcut_bound - static_eval : static_eval - probcut_bound;
+        auto beats_bound   = [&](int score) {
+            return (color == Color::WHITE) ? score >= probcut_bound : score <= probcut_bound;
+        };
+
+        for (int i = 0; i < possible_moves.count; i++) {
+            const bitboard_move_t& move = possible_moves.moves[i];
+            if (!is_capture(board, move, color) || !see_ge(board, move, see_threshold)) {
+                continue;
+            }
+
+            if (ply < MAX_PLY) {
+                int from_idx            = __builtin_ctzll(move.from_board);
+                search_stack[ply].move  = move;
+                search_stack[ply].piece = board.at(from_idx % 8, from_idx / 8).piece.type;
+            }
+            piece_t cap_piece   = make_move(board, move, ply);
+            SearchResult result = qsearch(board, probcut_alpha, probcut_beta, !color, ply + 1);
+            nodes += result.nodes;
+            if (!search_aborted() && beats_bound(result.score)) {
+                result = negamax(board, depth - PROBCUT_REDUCTION, probcut_alpha, probcut_beta, !color, ply + 1);
+                nodes += result.nodes;
+            }
+            moves::undo_move(board, move, cap_piece);
+
+            if (search_aborted()) {
+                return {best_score, nodes};
+            }
+            if (beats_bound(result.score)) {
+                stats.probcut_cutoffs++;
+                return {result.score, nodes};
+            }
+        }
+    }
+
+    bool pv_node = original_alpha + 1 < original_beta;
+    order_moves(board, possible_moves, color, ply, hash_move, pv_node || depth >= GAIN_ORDER_MIN_DEPTH);
 
     for (int i = 0; i < possible_moves.count; i++) {
-        piece_t cap_piece   = moves::make_move(board, possible_moves.moves[i]);
-        SearchResult result = negamax(board, depth - 1, alpha, beta, !color);
+        // The eldest brother is done without a cutoff, hand the younger ones to the workers
+        if (i > 0 && context.parallel_mode == ParallelMode::YBWC && depth >= YBWC_MIN_DEPTH &&
+            context.task_deques.size() > 1) {
+            split_point_t split_point(board, active_split_point, depth, ply, color, in_check);
+            split_point.alpha      = alpha;
+            split_point.beta       = beta;
+            split_point.best_score = best_score;
+            split_point.best_move  = best_move;
+            for (int back = 1; back <= CONTINUATION_PLIES && back <= ply; back++) {
+                split_point.previous[back - 1] = search_stack[ply - back];
+            }
+
+            // The younger brothers are pruned exactly like in the serial loop below, before they become tasks
+            vector<task_t> tasks;
+            for (int j = i; j < possible_moves.count; j++) {
+                const bitboard_move_t& move = possible_moves.moves[j];
+                bool is_quiet = !is_capture(board, move, color) && move.promotion_type == PieceType::EMPTY;
+                if (!prune_move(board, move, j, is_quiet, depth, ply, color, in_check, futile, late_move_pruning,
+                                improving)) {
+                    tasks.push_back({&split_point, move, j, is_quiet});
+                }
+            }
+            split_point.pending = int(tasks.size());
+            {
+                task_deque_t& own = *context.task_deques[thread_idx];
+                lock_guard<mutex> guard(own.lock);
+                own.tasks.insert(own.tasks.end(), tasks.begin(), tasks.end());
+            }
+
+            task_t task;
+            while (split_point.pending.load() > 0) {
+                if (pop_own_task(&split_point, task)) {
+                    nodes += execute_task(task, board);
+                } else if (steal_task_below(&split_point, task)) {
+                    bitboard_t task_board = task.split_point->board;
+                    nodes += execute_task(task, task_board);
+                } else {
+                    this_thread::yield(); // the rest is being searched by thieves
+                }
+            }
+
+            stats.split_points++;
+            stats.split_cutoffs += split_point.cutoff;
+            best_score = split_point.best_score;
+            best_move  = split_point.best_move;
+            if (split_point.cutoff && split_point.cutoff_is_quiet) {
+                update_cutoff_move(board, split_point.cutoff_move, color, ply, depth);
+                penalize_quiets(board, quiets_searched, quiet_count, color, ply, depth);
+                penalize_quiets(board, split_point.quiets_searched, split_point.quiet_count, color, ply, depth);
+            }
+            break;
+        }
+
+        const bitboard_move_t& move = possible_moves.moves[i];
+        bool is_quiet               = !is_capture(board, move, color) && move.promotion_type == PieceType::EMPTY;
+
+        if (prune_move(board, move, i, is_quiet, depth, ply, color, in_check, futile, late_move_pruning, improving)) {
+            continue;
+        }
+
+        SearchResult result = search_move(board, move, i, is_quiet, depth, ply, alpha, beta, color, in_check);
+        nodes += result.nodes;
+        if (search_aborted()) {
+            break;
+        }
+
+        if ((color == Color::WHITE && result.score > best_score) || (color == Color::BLACK && result.score < best_score)) {
+            best_score = result.score;
+            best_move  = move;
+        }
+        if (color == Color::WHITE) {
+            alpha = max(alpha, result.score);
+        } else {
+            beta = min(beta, result.score);
+        }
+
+        if (alpha >= beta) {
+            if (is_quiet) {
+                update_cutoff_move(board, move, color, ply, depth);
+                penalize_quiets(board, quiets_searched, quiet_count, color, ply, depth);
+            }
+            break; // Beta cutoff
+        }
+        if (is_quiet) {
+            quiets_searched[quiet_count++] = move;
+        }
+    }
+
+    // A search that was cut short has an unreliable score, so keep it out of the table
+    if (!search_aborted()) {
+        Bound bound = (best_score >= original_beta)    ? Bound::LOWER
+                      : (best_score <= original_alpha) ? Bound::UPPER
+                                                       : Bound::EXACT;
+        context.tt.store(hash_key, {score_to_tt(best_score, ply), depth, bound, best_move});
+    }
+
+    return {best_score, nodes};
+}
+
+// Quiescence search: only captures and promotions are played until the position is quiet, so the static evaluation is
+// never taken in the middle of an exchange. The side to move may stand pat on the static evaluation instead, unless it
+// is in check.
+SearchResult Searcher::qsearch(bitboard_t& board, int alpha, int beta, Color color, int ply) {
+    if (time_is_up() || split_point_aborted()) {
+        return {(color == Color::WHITE) ? NEG_INFINITY : POS_INFINITY, 1};
+    }
+    stats.qsearch_nodes++;
+
+    U64 hash_key = context.eval_cache.enabled() ? hash_t::compute_hash(board) : 0;
+    if (ply >= MAX_PLY) {
+        return {evaluate(board, ply, hash_key, alpha, beta), 1};
+    }
+
+    // In check there is no standing pat, all evasions are searched and without one it is mate
+    bool in_check = moves::is_in_check(board, color);
+    int best_score;
+    move_list_t captures;
+    if (in_check) {
+        captures = moves::generate_all_moves_for_color(board, color);
+        if (captures.count == 0) {
+            return {(color == Color::WHITE) ? -(MATE_SCORE - ply) : MATE_SCORE - ply, 1};
+        }
+        best_score = (color == Color::WHITE) ? NEG_INFINITY : POS_INFINITY;
+    } else {
+        best_score = evaluate(board, ply, hash_key, alpha, beta);
+        if (color == Color::WHITE) {
+            if (best_score >= beta) {
+                return {best_score, 1};
+            }
+            alpha = max(alpha, best_score);
+        } else {
+            if (best_score <= alpha) {
+                return {best_score, 1};
+            }
+            beta = min(beta, best_score);
+        }
+        captures = moves::generate_captures_for_color(board, color);
+    }
+    order_moves(board, captures, color, ply);
+    int nodes = 1;
+
+    for (int i = 0; i < captures.count; i++) {
+        const bitboard_move_t& move = captures.moves[i];
+
+        // Losing the exchange can only be worse than standing pat
+        if (!in_check && !see_ge(board, move, 0)) {
+            stats.see_pruned++;
+            continue;
+        }
+
+        piece_t cap_piece   = make_move(board, move, ply);
+        SearchResult result = qsearch(board, alpha, beta, !color, ply + 1);
+        moves::undo_move(board, move, cap_piece);
         nodes += result.nodes;
+        if (search_aborted()) {
+            break;
+        }
 
         if (color == Color::WHITE) {
             best_score = max(best_score, result.score);
@@ -59,60 +1342,339 @@ SearchResult negamax(bitboard_t& board, int depth, int alpha, int beta, Color co
             best_score = min(best_score, result.score);
             beta       = min(beta, result.score);
         }
-
-        moves::undo_move(board, possible_moves.moves[i], cap_piece);
-
         if (alpha >= beta) {
-            break; // Beta cutoff
+            break;
         }
     }
 
     return {best_score, nodes};
 }
 
-pair<bitboard_move_t, SearchResult> get_best_move(bitboard_t& board, int depth, Color color) {
+void Searcher::init_root_moves(bitboard_t& board, Color color) {
     move_list_t possible_moves = moves::generate_all_moves_for_color(board, color);
 
     if (possible_moves.count == 0) {
         throw runtime_error("No legal moves available");
     }
+    order_moves(board, possible_moves, color, 0);
 
-    bitboard_move_t best_move = possible_moves.moves[0];
-    SearchResult best_result  = {(color == Color::WHITE) ? NEG_INFINITY : POS_INFINITY, 0};
-
+    root_moves.clear();
     for (int i = 0; i < possible_moves.count; i++) {
+        root_moves.push_back({possible_moves.moves[i], 0, 0, 0, {}});
+    }
+    root_hash = hash_t::compute_hash(board);
+}
+
+// The given move followed by the best moves stored in the transposition table. Each one is checked for legality, since
+// another position may have overwritten the entry, and the line ends at the first position that repeats.
+vector<bitboard_move_t> Searcher::extract_pv(bitboard_t& board, const bitboard_move_t& move, Color color,
+                                             int max_length) {
+    vector<bitboard_move_t> pv = {move};
+    vector<piece_t> captured   = {moves::make_move(board, move)};
 
-        // Testing the time
-        t        = chrono::high_resolution_clock::now();
-        duration = chrono::duration_cast<chrono::milliseconds>(t - t0).count();
-        if (duration > time_limit) {
-            return {best_move, best_result};
+    tt_entry_t tt_entry;
+    while (int(pv.size()) < max_length && !hash_t::is_threefold_repetition(board) &&
+           context.tt.probe(hash_t::compute_hash(board), tt_entry)) {
+        color                      = !color;
+        move_list_t possible_moves = moves::generate_all_moves_for_color(board, color);
+        bool is_legal              = false;
+        for (int i = 0; i < possible_moves.count && !is_legal; i++) {
+            is_legal = same_move(possible_moves.moves[i], tt_entry.best_move);
+        }
+        if (!is_legal) {
+            break;
         }
+        pv.push_back(tt_entry.best_move);
+        captured.push_back(moves::make_move(board, tt_entry.best_move));
+    }
 
-        piece_t cap_piece   = moves::make_move(board, possible_moves.moves[i]);
-        SearchResult result = negamax(board, depth - 1, NEG_INFINITY, POS_INFINITY, !color);
+    for (int i = int(pv.size()) - 1; i >= 0; i--) {
+        moves::undo_move(board, pv[i], captured[i]);
+    }
+    return pv;
+}
+
+// Searches the root moves in the order of the previous iteration, so the previous best move comes first. If the search
+// is stopped, the move being searched is dropped and the best of the moves that were searched completely is returned.
+// Any move other than the first can only be that best move by scoring above the first one, so even a cut short
+// iteration returns a move proven better than the previous best (or the previous best itself). Only completed
+// iterations reorder the root moves.
+pair<bitboard_move_t, SearchResult> Searcher::get_best_move(bitboard_t& board, int depth, Color color) {
+    if (root_moves.empty() || root_hash != hash_t::compute_hash(board)) {
+        init_root_moves(board, color);
+    }
+
+    int worst_score           = (color == Color::WHITE) ? NEG_INFINITY : POS_INFINITY;
+    bitboard_move_t best_move = root_moves[0].move;
+    SearchResult best_result  = {worst_score, 0};
+    int alpha                 = NEG_INFINITY;
+    int beta                  = POS_INFINITY;
+
+    for (RootMove& root_move : root_moves) {
+        int from_idx    = __builtin_ctzll(root_move.move.from_board);
+        search_stack[0] = {root_move.move, board.at(from_idx % 8, from_idx / 8).piece.type, NO_EVAL};
+
+        piece_t cap_piece   = make_move(board, root_move.move, 0);
+        SearchResult result = negamax(board, depth - 1, alpha, beta, !color, 1);
+        moves::undo_move(board, root_move.move, cap_piece);
+        best_result.nodes += result.nodes;
+
+        if (context.stop.load(memory_order_relaxed)) {
+            break;
+        }
+        root_move.previous_score = root_move.score;
+        root_move.score          = result.score; // exact for moves that raised the bound, the fail-low bound otherwise
+        root_move.nodes          = result.nodes;
 
         if ((color == Color::WHITE && result.score > best_result.score) ||
             (color == Color::BLACK && result.score < best_result.score)) {
-            best_result = result;
-            best_move   = possible_moves.moves[i];
+            best_result.score = result.score;
+            best_move         = root_move.move;
+            root_move.pv      = extract_pv(board, root_move.move, color, depth);
+        } else {
+            root_move.pv = {root_move.move};
+        }
+        if (color == Color::WHITE) {
+            alpha = max(alpha, result.score);
+        } else {
+            beta = min(beta, result.score);
         }
+    }
 
-        moves::undo_move(board, possible_moves.moves[i], cap_piece);
-        best_result.nodes += result.nodes;
+    // The best move goes first even if a later move failed low onto the same score. Moves that failed low against the
+    // same bound tie on this iteration's score, the previous one breaks the tie
+    if (!context.stop.load(memory_order_relaxed)) {
+        stable_sort(root_moves.begin(), root_moves.end(), [color, &best_move](const RootMove& a, const RootMove& b) {
+            bool a_best = same_move(a.move, best_move);
+            bool b_best = same_move(b.move, best_move);
+            if (a_best != b_best) {
+                return a_best;
+            }
+            if (a.score != b.score) {
+                return (color == Color::WHITE) ? a.score > b.score : a.score < b.score;
+            }
+            if (a.previous_score != b.previous_score) {
+                return (color == Color::WHITE) ? a.previous_score > b.previous_score
+                                               : a.previous_score < b.previous_score;
+            }
+            return a.nodes > b.nodes;
+        });
     }
 
-    unique_best_move = best_move;
+    stats.nodes += best_result.nodes;
     return {best_move, best_result};
 }
 
+// Iterative deepening until the time manager says stop. The move of the deepest completed iteration is returned (and
+// kept in result), or a proven better one from the iteration that was cut short.
+RootResult Searcher::search(bitboard_t& board, Color color) {
+    // In the tablebases the distance to zeroing picks the move, no search needed
+    bitboard_move_t tb_move;
+    syzygy::wdl_t wdl;
+    if (context.tablebases != nullptr && context.tablebases->probe_root(board, tb_move, wdl)) {
+        int score = (wdl == syzygy::WIN) ? TB_WIN_SCORE : (wdl == syzygy::LOSS) ? -TB_WIN_SCORE : 0;
+        stats.tb_hits++;
+        result = {tb_move, (color == Color::WHITE) ? score : -score, 0, 1, {tb_move}};
+        return result;
+    }
+
+    init_root_moves(board, color);
+    result = {root_moves[0].move, 0, 0, 0, {root_moves[0].move}};
+
+    for (int depth = 1; depth < MAX_PLY; depth++) {
+        auto [move, iteration] = get_best_move(board, depth, color);
+        result.nodes += iteration.nodes;
+
+        if (context.stop.load()) {
+            if (!same_move(move, result.best_move)) {
+                result.best_move = move;
+                result.pv        = {move};
+            }
+            break;
+        }
+        bool best_move_changed = !same_move(move, result.best_move);
+        result.best_move       = move;
+        result.score           = iteration.score;
+        result.completed_depth = depth;
+        result.pv              = root_moves[0].pv;
+
+        // The search raises the stop flag itself at the hard limit. Past the soft limit we just stop deepening
+        context.time_manager.on_iteration_done(best_move_changed);
+        if (!context.time_manager.can_start_iteration(context.elapsed_ms())) {
+            break;
+        }
+    }
+    return result;
+}
+
+// While its split point is being finished by others, the owner only helps with tasks further down the same subtree.
+// Anything else could still be running when the split point is done, and the owner has to return to it then.
+bool Searcher::steal_task_below(const split_point_t* split_point, task_t& task) {
+    auto& deques = context.task_deques;
+    for (size_t i = 1; i < deques.size(); i++) {
+        task_deque_t& victim = *deques[(thread_idx + i) % deques.size()];
+        lock_guard<mutex> guard(victim.lock);
+        for (auto it = victim.tasks.begin(); it != victim.tasks.end(); ++it) {
+            for (const split_point_t* ancestor = it->split_point->parent; ancestor; ancestor = ancestor->parent) {
+                if (ancestor == split_point) {
+                    task = *it;
+                    victim.tasks.erase(it);
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+// ---- LAZY SMP ----
+
+// Helper threads run the same iterative deepening as the main thread, each on its own copy of the board and with its
+// own searcher. They only communicate through the transposition table.
+void Searcher::helper_search(bitboard_t board, Color color) {
+    // Every other helper starts a ply deeper, so the threads are not all working on the same depth at once
+    init_root_moves(board, color);
+    for (int depth = 1 + thread_idx % 2; depth < MAX_PLY && !context.stop.load(); depth++) {
+        get_best_move(board, depth, color);
+    }
+}
+
+// YBWC workers have no search of their own, they just keep stealing tasks until the search is over
+void Searcher::worker_loop() {
+    task_t task;
+    while (!context.stop.load()) {
+        if (steal_task(task)) {
+            bitboard_t board = task.split_point->board;
+            stats.nodes += execute_task(task, board);
+        } else {
+            this_thread::yield();
+        }
+    }
+}
+
+SearchContext::SearchContext(transposition_table_t& table, chrono::high_resolution_clock::time_point start)
+    : tt(table), start_time(start) {}
+
+SearchContext::~SearchContext() {
+    stop_helper_threads();
+}
+
+void SearchContext::start_helper_threads(const bitboard_t& board, Color color, int count) {
+    for (int i = 1; i <= count; i++) {
+        helpers.push_back(make_unique<Searcher>(*this, i));
+    }
+
+    if (parallel_mode == ParallelMode::YBWC) {
+        for (int i = 0; i <= count; i++) {
+            task_deques.push_back(make_unique<task_deque_t>());
+        }
+        for (auto& helper : helpers) {
+            helper_threads.emplace_back(&Searcher::worker_loop, helper.get());
+        }
+        return;
+    }
+
+    for (auto& helper : helpers) {
+        helper_threads.emplace_back(&Searcher::helper_search, helper.get(), board, color);
+    }
+}
+
+void SearchContext::stop_helper_threads() {
+    stop = true;
+    for (thread& helper : helper_threads) {
+        helper.join();
+    }
+    helper_threads.clear();
+}
+
+// Every node is counted by the thread that searched it, so the per-thread counts add up to the total
+void SearchContext::print_search_report(const Searcher& main_searcher) const {
+    const RootResult& result = main_searcher.result;
+    long elapsed             = max(elapsed_ms(), 1L);
+    long long main_nodes     = result.nodes;
+    long long total_nodes    = main_nodes;
+    long long pawn_probes    = main_searcher.stats.pawn_table_probes;
+    long long pawn_hits      = main_searcher.stats.pawn_table_hits;
+    cout << (parallel_mode == ParallelMode::YBWC ? "YBWC" : "Lazy SMP") << ", completed depth " << result.completed_depth
+         << "\n";
+    cout << "PV:";
+    for (const bitboard_move_t& move : result.pv) {
+        cout << " " << encode_move(bitboard_move_to_coordinate_move(move));
+    }
+    cout << "\n";
+    cout << "Main thread: " << main_nodes << " nodes\n";
+    for (size_t i = 0; i < helpers.size(); i++) {
+        cout << "Helper " << helpers[i]->thread_id() << ": " << helpers[i]->stats.nodes << " nodes\n";
+        total_nodes += helpers[i]->stats.nodes;
+        pawn_probes += helpers[i]->stats.pawn_table_probes;
+        pawn_hits += helpers[i]->stats.pawn_table_hits;
+    }
+    double total_nps = total_nodes * 1000.0 / elapsed;
+    double main_nps  = main_nodes * 1000.0 / elapsed;
+    cout << "Total: " << total_nodes << " nodes in " << elapsed << "ms (" << fixed << setprecision(0) << total_nps
+         << " NPS, " << setprecision(2) << (main_nps > 0 ? total_nps / main_nps : 0.0) << "x the main thread)\n";
+    long long cache_probes = main_searcher.stats.eval_cache_probes;
+    long long cache_hits   = main_searcher.stats.eval_cache_hits;
+    for (const auto& helper : helpers) {
+        cache_probes += helper->stats.eval_cache_probes;
+        cache_hits += helper->stats.eval_cache_hits;
+    }
+    if (cache_probes > 0) {
+        cout << "Eval cache: " << setprecision(1) << 100.0 * cache_hits / cache_probes << "% hits of " << cache_probes
+             << " probes\n";
+    }
+    if (pawn_probes > 0) {
+        cout << "Pawn table: " << setprecision(1) << 100.0 * pawn_hits / pawn_probes << "% hits of " << pawn_probes
+             << " probes\n";
+    }
+    long long evaluations      = main_searcher.stats.evaluations;
+    long long lazy_evaluations = main_searcher.stats.lazy_evaluations;
+    for (const auto& helper : helpers) {
+        evaluations += helper->stats.evaluations;
+        lazy_evaluations += helper->stats.lazy_evaluations;
+    }
+    if (evaluations > 0) {
+        cout << "Lazy eval: " << setprecision(1) << 100.0 * lazy_evaluations / evaluations << "% of " << evaluations
+             << " evaluations\n";
+    }
+    SearchStats pruning = main_searcher.stats;
+    for (const auto& helper : helpers) {
+        pruning.see_pruned += helper->stats.see_pruned;
+        pruning.reverse_futility_pruned += helper->stats.reverse_futility_pruned;
+        pruning.futility_pruned += helper->stats.futility_pruned;
+        pruning.razored += helper->stats.razored;
+        pruning.probcut_cutoffs += helper->stats.probcut_cutoffs;
+        pruning.late_move_pruned += helper->stats.late_move_pruned;
+        pruning.history_pruned += helper->stats.history_pruned;
+    }
+    cout << "Pruned: " << pruning.see_pruned << " SEE, " << pruning.reverse_futility_pruned << " reverse futility, "
+         << pruning.futility_pruned << " futility, " << pruning.razored << " razored, " << pruning.probcut_cutoffs
+         << " ProbCut, " << pruning.late_move_pruned << " late moves, " << pruning.history_pruned << " history\n";
+    long long tb_hits = main_searcher.stats.tb_hits;
+    for (const auto& helper : helpers) {
+        tb_hits += helper->stats.tb_hits;
+    }
+    if (tb_hits > 0) {
+        cout << "Tablebase hits: " << tb_hits << "\n";
+    }
+    if (parallel_mode == ParallelMode::YBWC) {
+        long long split_points  = main_searcher.stats.split_points;
+        long long split_cutoffs = main_searcher.stats.split_cutoffs;
+        for (const auto& helper : helpers) {
+            split_points += helper->stats.split_points;
+            split_cutoffs += helper->stats.split_cutoffs;
+        }
+        cout << "Split points: " << split_points << ", " << split_cutoffs << " cut off\n";
+    }
+}
+
 // ---- FOR TESTING ----
 
-SearchResult negamax_without_pruning(bitboard_t& board, int depth, Color color) {
+// Plain minimax over the full tree, down to the same quiescence search at the leaves
+SearchResult negamax_without_pruning(Searcher& searcher, bitboard_t& board, int depth, Color color) {
     if (depth == 0) {
-        return {color == Color::WHITE ? eval::evaluate_position(board)
-                                      : -eval::evaluate_position(board),
-                1};
+        int score = searcher.qsearch(board, NEG_INFINITY, POS_INFINITY, color, 0).score;
+        return {color == Color::WHITE ? score : -score, 1};
     }
 
     move_list_t possible_moves = moves::generate_all_moves_for_color(board, color);
@@ -121,7 +1683,7 @@ SearchResult negamax_without_pruning(bitboard_t& board, int depth, Color color)
 
     for (int i = 0; i < possible_moves.count; i++) {
         piece_t cap_piece   = moves::make_move(board, possible_moves.moves[i]);
-        SearchResult result = negamax_without_pruning(board, depth - 1, !color);
+        SearchResult result = negamax_without_pruning(searcher, board, depth - 1, !color);
         nodes += result.nodes;
         int score = -result.score;
         max_score = max(max_score, score);
@@ -131,8 +1693,34 @@ SearchResult negamax_without_pruning(bitboard_t& board, int depth, Color color)
     return {max_score, nodes};
 }
 
+// The move ordering state is private to the search, the tests reach it through here
+struct SearcherInspector {
+    static void set_stack_move(Searcher& searcher, int ply, const bitboard_move_t& move, PieceType piece) {
+        searcher.search_stack[ply] = {move, piece, NO_EVAL};
+    }
+
+    static void update_cutoff_move(Searcher& searcher, const bitboard_t& board, const bitboard_move_t& move, Color color,
+                                   int ply, int depth) {
+        searcher.update_cutoff_move(board, move, color, ply, depth);
+    }
+
+    static bitboard_move_t counter_move(const Searcher& searcher, Color color, PieceType piece, int to_idx) {
+        return searcher.counter_moves[color_index(color)][piece_index(piece)][to_idx];
+    }
+
+    static int quiet_history(const Searcher& searcher, const bitboard_move_t& move, PieceType piece, Color color,
+                             int ply) {
+        return searcher.quiet_history(move, piece, color, ply);
+    }
+
+    static void order_moves(const Searcher& searcher, const bitboard_t& board, move_list_t& move_list, Color color,
+                            int ply) {
+        searcher.order_moves(board, move_list, color, ply);
+    }
+};
+
 // ---------------------
 
 } // namespace engine
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,58 @@
+#ifndef eval_cache_hpp
+#define eval_cache_hpp
+
+#include "move_t.hpp"
+#include <atomic>
+#include <memory>
+
+// Static evaluations by position key, shared by all search threads. Every slot is a single 64 bit word holding the
+// upper half of the key, to verify the hit, and the score in the lower half. A word is written and read in one go, so
+// unlike the transposition table no entry can ever be torn and no locking is needed at all. Collisions just overwrite.
+class eval_cache_t {
+  private:
+    std::unique_ptr<std::atomic<U64>[]> slots;
+    U64 mask = 0; // number of slots - 1, the size is always a power of two
+
+    static U64 verification(U64 key) {
+        return key & 0xFFFFFFFF00000000ULL;
+    }
+
+  public:
+    explicit eval_cache_t(size_t size_mb) {
+        resize(size_mb);
+    }
+
+    // A size of 0 turns the cache off
+    void resize(size_t size_mb) {
+        if (size_mb == 0) {
+            slots.reset();
+            mask = 0;
+            return;
+        }
+        size_t count = 1;
+        while (count * 2 * sizeof(std::atomic<U64>) <= size_mb * 1024 * 1024) {
+            count *= 2;
+        }
+        slots = std::make_unique<std::atomic<U64>[]>(count);
+        mask  = count - 1;
+    }
+
+    bool enabled() const {
+        return slots != nullptr;
+    }
+
+    bool probe(U64 key, int& score) const {
+        U64 data = slots[key & mask].load(std::memory_order_relaxed);
+        if (verification(data) != verification(key) || data == 0) {
+            return false;
+        }
+        score = int(uint32_t(data));
+        return true;
+    }
+
+    void store(U64 key, int score) {
+        slots[key & mask].store(verification(key) | uint32_t(score), std::memory_order_relaxed);
+    }
+};
+
+#endif
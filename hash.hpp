@@ -2,6 +2,7 @@
 #define hash_hpp
 
 #include "board_t.hpp"
+#include <algorithm>
 #include <random>
 
 class hash_t {
@@ -40,7 +41,79 @@ class hash_t {
 
     static position_keys_t keys;
 
+    // Cuckoo tables of reversible moves, indexed by the key difference a move makes (piece on both squares plus the
+    // side to move). Every king, queen, rook, bishop and knight move between two squares on an empty board gets one
+    // slot, so a position that differs from an earlier one by a single such move is found with two lookups.
+    static constexpr int CUCKOO_SIZE = 8192;
+
+    struct cuckoo_entry_t {
+        U64 key = 0;
+        int8_t from = 0;
+        int8_t to   = 0;
+    };
+
+    struct cuckoo_table_t {
+        cuckoo_entry_t entries[CUCKOO_SIZE];
+
+        static int first_slot(U64 key) { return key & (CUCKOO_SIZE - 1); }
+        static int second_slot(U64 key) { return (key >> 16) & (CUCKOO_SIZE - 1); }
+
+        static bool reaches(int piece, int from, int to) {
+            int dx = abs(to % 8 - from % 8);
+            int dy = abs(to / 8 - from / 8);
+            switch (piece % 6) {
+            case 0: return max(dx, dy) == 1;             // king
+            case 1: return dx == 0 || dy == 0 || dx == dy; // queen
+            case 2: return dx == 0 || dy == 0;           // rook
+            case 3: return dx == dy;                     // bishop
+            case 4: return dx * dy == 2;                 // knight
+            default: return false;                       // pawn moves are never reversible
+            }
+        }
+
+        // Needs the Zobrist keys, so `keys` has to be defined before `cuckoo`
+        cuckoo_table_t() {
+            for (int piece = 0; piece < 12; piece++) {
+                for (int from = 0; from < 64; from++) {
+                    for (int to = from + 1; to < 64; to++) {
+                        if (!reaches(piece, from, to)) {
+                            continue;
+                        }
+                        cuckoo_entry_t entry = {
+                            keys.piece_square[piece][from] ^ keys.piece_square[piece][to] ^ keys.side_to_move,
+                            int8_t(from), int8_t(to)};
+
+                        // Kick out whatever sits in the slot and move it to its other slot, until a slot was empty
+                        int slot = first_slot(entry.key);
+                        while (true) {
+                            swap(entries[slot], entry);
+                            if (entry.key == 0) {
+                                break;
+                            }
+                            slot = (slot == first_slot(entry.key)) ? second_slot(entry.key) : first_slot(entry.key);
+                        }
+                    }
+                }
+            }
+        }
+
+        const cuckoo_entry_t* find(U64 move_key) const {
+            const cuckoo_entry_t* entry = &entries[first_slot(move_key)];
+            if (entry->key == move_key) {
+                return entry;
+            }
+            entry = &entries[second_slot(move_key)];
+            return (entry->key == move_key) ? entry : nullptr;
+        }
+    };
+
+    static cuckoo_table_t cuckoo;
+
   public:
+    // Stands in the position history for a null move. Repetitions are only looked for after the last one, as the
+    // positions before it were not reached by moves and are off by one in the side to move
+    static constexpr U64 NULL_MOVE_KEY = 0;
+
     static U64 compute_hash(const bitboard_t& board) {
         U64 hash       = 0;
         U64 all_pieces = board.get_all_pieces();
@@ -106,9 +179,10 @@ class hash_t {
         U64 current_hash = compute_hash(board);
         int count        = 0;
 
-        // Check history for same position
-        for (const U64& hash : board.position_hash_history) {
-            if (hash == current_hash) {
+        // Check history for same position, back to the last null move
+        const vector<U64>& history = board.position_hash_history;
+        for (auto it = history.rbegin(); it != history.rend() && *it != NULL_MOVE_KEY; ++it) {
+            if (*it == current_hash) {
                 count++;
                 if (count >= 2) { // Current position + 2 previous = 3 occurrences
                     return true;
@@ -118,9 +192,48 @@ class hash_t {
 
         return false;
     }
+
+    // Whether the side to move can play a reversible move that reaches an earlier position, ie. whether it can at least
+    // force a draw by repetition. Only every second position back can be one move away, and a capture, pawn move or
+    // castling right change in between leaves a key difference no single move has. Positions reached during the search
+    // count after one repetition, positions from before the root only if repeating them is an actual threefold.
+    static bool has_upcoming_repetition(const bitboard_t& board, int ply) {
+        const vector<U64>& history = board.position_hash_history;
+        auto first                 = std::find(history.rbegin(), history.rend(), NULL_MOVE_KEY).base();
+        int plies                  = int(history.end() - first);
+        if (plies < 3) {
+            return false;
+        }
+
+        U64 current_hash = compute_hash(board);
+        U64 occupied     = board.get_all_pieces();
+
+        for (int back = 3; back <= plies; back += 2) {
+            U64 earlier_hash            = first[plies - back];
+            const cuckoo_entry_t* entry = cuckoo.find(current_hash ^ earlier_hash);
+            if (!entry || (board.get_path_mask(entry->from, entry->to) & occupied)) {
+                continue;
+            }
+            if (ply > back) {
+                return true;
+            }
+
+            // The move has to be ours, not the one that would undo the last move of the opponent
+            int square = (occupied & (1ULL << entry->from)) ? entry->from : entry->to;
+            if (!(board.get_all_friendly_pieces(board.active_color) & (1ULL << square))) {
+                continue;
+            }
+            if (count(first, history.end(), earlier_hash) >= 2) {
+                return true;
+            }
+        }
+
+        return false;
+    }
 };
 
-// Define the static member for use in other header files
+// Define the static members for use in other header files, the keys first since the cuckoo tables are built from them
 hash_t::position_keys_t hash_t::keys;
+hash_t::cuckoo_table_t hash_t::cuckoo;
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef kpk_hpp
+#define kpk_hpp
+
+#include "moves.hpp"
+#include <cstdint>
+#include <vector>
+
+// King and pawn against king, solved by retrograde analysis. Positions are always seen from the side with the pawn,
+// as white, and with the pawn on files a to d, the others are mirrored. That leaves 2 sides to move * 64 * 64 king
+// squares * 24 pawn squares, one bit each telling whether the pawn side wins, 24 KB in total.
+namespace kpk {
+
+constexpr int SIZE = 2 * 64 * 64 * 24;
+
+// side to move (0 for white) | black king | white king | pawn file | 6 - pawn rank
+inline int index(int side, int black_king, int white_king, int pawn) {
+    return side | (black_king << 1) | (white_king << 7) | ((pawn % 8) << 13) | ((6 - pawn / 8) << 15);
+}
+
+inline int distance(int a, int b) {
+    return max(abs(a % 8 - b % 8), abs(a / 8 - b / 8));
+}
+
+class bitbase_t {
+  private:
+    // Results are bit flags, so the results of all moves can be or'ed together
+    enum result_t : uint8_t { INVALID = 0, UNKNOWN = 1, DRAW = 2, WIN = 4 };
+
+    std::vector<uint32_t> wins = std::vector<uint32_t>(SIZE / 32);
+
+    // What is known without looking at any move: illegal positions, safe promotions, stalemates and lost pawns
+    static uint8_t initial_result(int side, int black_king, int white_king, int pawn) {
+        const U64 black_king_moves = moves::king_attack_table[black_king];
+        const U64 white_king_moves = moves::king_attack_table[white_king];
+
+        if (distance(white_king, black_king) <= 1 || white_king == pawn || black_king == pawn ||
+            (side == 0 && (moves::PAWN_ATTACKS_WHITE[pawn] & (1ULL << black_king)))) {
+            return INVALID;
+        }
+        if (side == 0 && pawn / 8 == 6 && white_king != pawn + 8 &&
+            (distance(black_king, pawn + 8) > 1 || distance(white_king, pawn + 8) == 1)) {
+            return WIN;
+        }
+        if (side == 1 && !(black_king_moves & ~(white_king_moves | moves::PAWN_ATTACKS_WHITE[pawn]))) {
+            return DRAW;
+        }
+        if (side == 1 && (black_king_moves & ~white_king_moves & (1ULL << pawn))) {
+            return DRAW;
+        }
+        return UNKNOWN;
+    }
+
+    // White wins if any move wins, black draws if any move draws. Moves into illegal positions are INVALID, so they
+    // add nothing to the result
+    static uint8_t classify(const std::vector<uint8_t>& results, int side, int black_king, int white_king, int pawn) {
+        const uint8_t good = side == 0 ? WIN : DRAW;
+        const uint8_t bad  = side == 0 ? DRAW : WIN;
+
+        uint8_t result = INVALID;
+        for (U64 targets = moves::king_attack_table[side == 0 ? white_king : black_king]; targets;
+             targets &= targets - 1) {
+            int to = __builtin_ctzll(targets);
+            result |= side == 0 ? results[index(1, black_king, to, pawn)] : results[index(0, to, white_king, pawn)];
+        }
+        if (side == 0 && pawn / 8 < 6) {
+            result |= results[index(1, black_king, white_king, pawn + 8)];
+        }
+        if (side == 0 && pawn / 8 == 1 && pawn + 8 != white_king && pawn + 8 != black_king) {
+            result |= results[index(1, black_king, white_king, pawn + 16)];
+        }
+
+        if (result & good) {
+            return good;
+        }
+        return (result & UNKNOWN) ? uint8_t(UNKNOWN) : bad;
+    }
+
+  public:
+    bitbase_t() {
+        std::vector<uint8_t> results(SIZE);
+        auto decode = [](int idx, int& side, int& black_king, int& white_king, int& pawn) {
+            side       = idx & 1;
+            black_king = (idx >> 1) & 63;
+            white_king = (idx >> 7) & 63;
+            pawn       = (6 - (idx >> 15)) * 8 + ((idx >> 13) & 3);
+        };
+
+        int side, black_king, white_king, pawn;
+        for (int idx = 0; idx < SIZE; idx++) {
+            decode(idx, side, black_king, white_king, pawn);
+            results[idx] = initial_result(side, black_king, white_king, pawn);
+        }
+
+        // Every pass resolves the positions one move further from a known result, until nothing changes any more.
+        // Whatever is still unknown then is a draw, neither side can force anything
+        for (bool changed = true; changed;) {
+            changed = false;
+            for (int idx = 0; idx < SIZE; idx++) {
+                if (results[idx] != UNKNOWN) {
+                    continue;
+                }
+                decode(idx, side, black_king, white_king, pawn);
+                results[idx] = classify(results, side, black_king, white_king, pawn);
+                changed |= results[idx] != UNKNOWN;
+            }
+        }
+
+        for (int idx = 0; idx < SIZE; idx++) {
+            if (results[idx] == WIN) {
+                wins[idx / 32] |= 1u << (idx % 32);
+            }
+        }
+    }
+
+    bool is_win(int idx) const {
+        return wins[idx / 32] & (1u << (idx % 32));
+    }
+};
+
+// Squares as seen from the side with the pawn, playing up the board. The bitbase is generated on the first probe, which
+// takes a few milliseconds
+bool probe(int strong_king, int pawn, int weak_king, bool strong_to_move) {
+    static const bitbase_t bitbase;
+    if (pawn % 8 >= 4) {
+        strong_king ^= 7;
+        pawn ^= 7;
+        weak_king ^= 7;
+    }
+    return bitbase.is_win(index(strong_to_move ? 0 : 1, weak_king, strong_king, pawn));
+}
+
+} // namespace kpk
+
+#endif
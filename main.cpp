@@ -4,24 +4,80 @@
 #include "file_util.hpp"
 #include "move_t.hpp"
 #include "moves.hpp"
+#include "syzygy.hpp"
 #include "tests.hpp"
 #include <unistd.h>
 #include <chrono>
 
-chrono::high_resolution_clock::time_point t0 = chrono::high_resolution_clock::now();
-chrono::high_resolution_clock::time_point t;
-long duration;
-
-bitboard_move_t unique_best_move;
-
-int main(int argc, char const* argv[]) // ./BlueHerring -H history.csv -m move.csv {locale::global(locale("en_US.UTF-8")); // To enable printing of unicode characters}
+int main(int argc, char const* argv[]) // ./BlueHerring -H history.csv -m move.csv [--wtime ms --btime ms --winc ms --binc ms] [--threads N] [--parallel lazysmp|ybwc] [--param name=value] [--nnue weights.bin] [--eval-cache-mb N] [--syzygy-path dir] [--syzygy-probe-limit N] {locale::global(locale("en_US.UTF-8")); // To enable printing of unicode characters}
 {
-    if (argc != 5) {
+    auto start_time = chrono::high_resolution_clock::now(); // the clock runs from process start, setup is our time too
+    string input_file_name;
+    string output_file_name;
+    int helper_thread_count = 0; // Lazy SMP helpers searching alongside the main thread
+    long remaining_ms[2]    = {-1, -1}; // clock and increment for white and black, -1 if we were not told
+    long increment_ms[2]    = {0, 0};
+    engine::SearchContext context(engine::tt, start_time);
+    unique_ptr<nnue::network_t> network; // classic evaluation unless a weights file is given
+    unique_ptr<syzygy::tablebases_t> tablebases;
+    int syzygy_probe_limit = -1; // all tables found, unless we are told otherwise
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        string flag = argv[i];
+        if (flag == "-H") {
+            input_file_name = argv[i + 1];
+        } else if (flag == "-m") {
+            output_file_name = argv[i + 1];
+        } else if (flag == "--threads") {
+            helper_thread_count = max(0, atoi(argv[i + 1]));
+        } else if (flag == "--wtime") {
+            remaining_ms[0] = atol(argv[i + 1]);
+        } else if (flag == "--btime") {
+            remaining_ms[1] = atol(argv[i + 1]);
+        } else if (flag == "--winc") {
+            increment_ms[0] = atol(argv[i + 1]);
+        } else if (flag == "--binc") {
+            increment_ms[1] = atol(argv[i + 1]);
+        } else if (flag == "--parallel") { // lazysmp (default) or ybwc
+            string mode           = argv[i + 1];
+            context.parallel_mode = (mode == "ybwc") ? engine::ParallelMode::YBWC : engine::ParallelMode::LAZY_SMP;
+        } else if (flag == "--param") { // name=value, see engine::SearchParams
+            string param = argv[i + 1];
+            size_t split = param.find('=');
+            if (split == string::npos || !context.params.set(param.substr(0, split), atoi(param.c_str() + split + 1))) {
+                printf("Unknown parameter %s", param.c_str());
+                return -1;
+            }
+        } else if (flag == "--eval-cache-mb") { // 0 turns the cache off
+            context.eval_cache.resize(max(0, atoi(argv[i + 1])));
+        } else if (flag == "--nnue") {
+            network = make_unique<nnue::network_t>();
+            string error;
+            if (!network->load(argv[i + 1], error)) {
+                printf("Cannot load network: %s", error.c_str());
+                return -1;
+            }
+            printf("NNUE evaluation, %s kernels\n", nnue::simd_level_name(network->simd));
+            context.network = network.get();
+        } else if (flag == "--syzygy-path") {
+            tablebases   = make_unique<syzygy::tablebases_t>();
+            size_t count = tablebases->init(argv[i + 1]);
+            printf("Syzygy: %zu tables, up to %d pieces\n", count, tablebases->max_pieces);
+            context.tablebases = tablebases.get();
+        } else if (flag == "--syzygy-probe-limit") { // the search only probes at this many pieces or fewer
+            syzygy_probe_limit = max(0, atoi(argv[i + 1]));
+        } else {
+            printf("Unknown option %s", flag.c_str());
+            return -1;
+        }
+    }
+    if (argc % 2 != 1 || input_file_name.empty() || output_file_name.empty()) {
         printf("Wrong input size!, %i", argc);
         return -1;
     }
-    string input_file_name  = argv[2];
-    string output_file_name = argv[4];
+    if (tablebases != nullptr && syzygy_probe_limit >= 0) {
+        tablebases->probe_limit = min(syzygy_probe_limit, tablebases->max_pieces);
+    }
 
     // tests::run_rules_test_suite();
     // tests::run_perft_suite();
@@ -47,20 +103,22 @@ int main(int argc, char const* argv[]) // ./BlueHerring -H history.csv -m move.c
     }
     Color color_to_move = (moves.size() % 2 == 0) ? Color::WHITE : Color::BLACK;
 
-    // Timing fail-safe move
-    bitboard_move_t best_move_return = engine::get_best_move(bitboard, 2, color_to_move).first;
+    int side = (color_to_move == Color::WHITE) ? 0 : 1;
+    if (remaining_ms[side] >= 0) {
+        context.time_manager.init(remaining_ms[side], increment_ms[side], moves.size());
+    } else {
+        context.time_manager.init_fixed(time_limit);
+    }
 
-    for (int depth = 5; depth < 100; depth++) {
-        // Testing the time
-        t = chrono::high_resolution_clock::now();
-        duration = chrono::duration_cast<chrono::milliseconds>(t - t0).count();
-        if (duration > time_limit) {
-            break;
-        }
-        best_move_return = engine::get_best_move(bitboard, depth, color_to_move).first;        
-    }   
+    context.start_helper_threads(bitboard, color_to_move, helper_thread_count);
+
+    engine::Searcher searcher(context);
+    engine::RootResult result = searcher.search(bitboard, color_to_move);
+
+    context.stop_helper_threads();
+    context.print_search_report(searcher);
 
-    string best_move_str      = encode_move(bitboard_move_to_coordinate_move(unique_best_move));
+    string best_move_str      = encode_move(bitboard_move_to_coordinate_move(result.best_move));
     write_move_to_output_file(&output_file_name, &best_move_str);
     return 0;
 }
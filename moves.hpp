@@ -235,6 +235,12 @@ piece_t make_move(bitboard_t& board, const bitboard_move_t& move) {
             board.board_w_P &= ~capture_mask;
             captured_piece = {PieceType::PAWN, Color::WHITE};
         }
+        board.pawn_key ^= bitboard_t::pawn_square_key(captured_piece.color, __builtin_ctzll(capture_mask));
+    } else if (captured_piece.type == PieceType::PAWN) {
+        board.pawn_key ^= bitboard_t::pawn_square_key(captured_piece.color, to_idx);
+    }
+    if (captured_piece.type != PieceType::EMPTY) {
+        board.material_key -= bitboard_t::material_unit(captured_piece.type, captured_piece.color);
     }
 
     // Castling rook movement
@@ -259,6 +265,12 @@ piece_t make_move(bitboard_t& board, const bitboard_move_t& move) {
     board.move_history.push_back(move);
 
     // Make the actual move (and handle promotion)
+    if (moving_piece.type == PieceType::PAWN) {
+        board.pawn_key ^= bitboard_t::pawn_square_key(moving_piece.color, from_idx);
+        if (move.promotion_type == PieceType::EMPTY) {
+            board.pawn_key ^= bitboard_t::pawn_square_key(moving_piece.color, to_idx);
+        }
+    }
     if (move.promotion_type != PieceType::EMPTY) {
         // Remove pawn from source
         if (moving_piece.color == Color::WHITE) {
@@ -269,10 +281,14 @@ piece_t make_move(bitboard_t& board, const bitboard_move_t& move) {
         // Add promoted piece at destination
         U64* promoted_board = board.get_board_for_piece(move.promotion_type, moving_piece.color);
         *promoted_board |= to_square_mask;
+        board.material_key += bitboard_t::material_unit(move.promotion_type, moving_piece.color) -
+                              bitboard_t::material_unit(PieceType::PAWN, moving_piece.color);
     } else {
         // Regular move
         board.move_bit(piece_board, from_idx, to_idx);
     }
+
+    board.active_color = !board.active_color;
     return captured_piece;
 }
 
@@ -285,6 +301,7 @@ void undo_move(bitboard_t& board, const bitboard_move_t& move, const piece_t& ca
     board.move_history.pop_back();
     board.position_hash_history.pop_back();
     board.restore_previous_state();
+    board.active_color = !board.active_color;
 
     // Get moving piece (from destination square since the move was already made)
     piece_t moving_piece = board.at(to_idx % 8, to_idx / 8).piece;
@@ -334,6 +351,22 @@ void undo_move(bitboard_t& board, const bitboard_move_t& move, const piece_t& ca
     }
 }
 
+// Passes the turn to the opponent without moving a piece. Only used by null move pruning in the search, so the
+// "move" is not added to move_history. Its position goes into the hash history as a marker that repetitions are not
+// looked for beyond.
+void make_null_move(bitboard_t& board) {
+    board.save_current_state();
+    board.position_hash_history.push_back(hash_t::NULL_MOVE_KEY);
+    board.en_passant_square = 0; // the en passant right is lost when passing, just like after any other move
+    board.active_color      = !board.active_color;
+}
+
+void undo_null_move(bitboard_t& board) {
+    board.position_hash_history.pop_back();
+    board.restore_previous_state();
+    board.active_color = !board.active_color;
+}
+
 // Used for rook/queen
 U64 get_orthogonal_moves(U64 occupied, U64 friendly_pieces, int pos) {
     U64 orthogonal_moves    = 0;
@@ -473,6 +506,20 @@ bool is_in_check(bitboard_t& board, Color color) {
     return is_square_under_attack(board, color, king_pos % 8, king_pos / 8);
 }
 
+// All pieces of both colors attacking the square, with sliders seen through the given occupancy. Passing an occupancy
+// with pieces taken off lets the sliders behind them (x-rays) show up.
+U64 attackers_to(const bitboard_t& board, int pos, U64 occupied) {
+    U64 rooks   = board.board_w_R | board.board_b_R | board.board_w_Q | board.board_b_Q;
+    U64 bishops = board.board_w_B | board.board_b_B | board.board_w_Q | board.board_b_Q;
+
+    return (knight_attack_table[pos] & (board.board_w_N | board.board_b_N)) |
+           (king_attack_table[pos] & (board.board_w_K | board.board_b_K)) |
+           (PAWN_ATTACKS_BLACK[pos] & board.board_w_P) | // white pawns hit the square like a black pawn on it would
+           (PAWN_ATTACKS_WHITE[pos] & board.board_b_P) |
+           (get_orthogonal_moves(occupied, 0, pos) & rooks) |
+           (get_diagonal_moves(occupied, 0, pos) & bishops);
+}
+
 move_list_t get_knight_moves(bitboard_t& board, int x, int y) {
     int pos            = y * 8 + x;
     U64 from_square    = board.single_bitmask(pos);
@@ -751,6 +798,37 @@ move_list_t generate_all_moves_for_color(bitboard_t& board, Color color) {
     return all_moves;
 }
 
+// Legal captures and promotions only, for the quiescence search. Filtering before the legality check saves making and
+// undoing all the quiet moves.
+move_list_t generate_captures_for_color(bitboard_t& board, Color color) {
+    move_list_t captures;
+    U64 pieces  = board.get_all_friendly_pieces(color);
+    U64 enemies = board.get_all_friendly_pieces(!color);
+    U64 pawns   = board.board_w_P | board.board_b_P;
+
+    while (pieces) {
+        int square_idx          = __builtin_ctzll(pieces);
+        move_list_t piece_moves = get_piece_moves(board, square_idx % 8, square_idx / 8);
+
+        for (int i = 0; i < piece_moves.count; i++) {
+            const bitboard_move_t& move = piece_moves.moves[i];
+            bool en_passant             = (move.to_board & board.en_passant_square) && (move.from_board & pawns);
+            if (!(move.to_board & enemies) && !en_passant && move.promotion_type == PieceType::EMPTY) {
+                continue;
+            }
+            piece_t captured = make_move(board, move);
+            if (!is_in_check(board, color)) {
+                captures.add(move);
+            }
+            undo_move(board, move, captured);
+        }
+
+        pieces &= (pieces - 1);
+    }
+
+    return captures;
+}
+
 } // namespace moves
 
 #endif
\ No newline at end of file
@@ -0,0 +1,319 @@
+#ifndef nnue_hpp
+#define nnue_hpp
+
+#include "board_t.hpp"
+#include "move_t.hpp"
+#include "piece_t.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define NNUE_X86 1
+#endif
+
+using namespace std;
+
+// An optional neural network evaluation, used instead of eval::evaluate_position when a weights file is given.
+//
+// The network is as simple as they come: 768 inputs (one per piece type, color and square), a single hidden layer
+// with clipped ReLU and one output, always from white's perspective. The hidden layer before the activation is the
+// accumulator. A move only changes two to four inputs, so the accumulator of a child is its parent's plus and minus a
+// few weight rows, which is what makes the network affordable at every node.
+//
+// Everything is quantised: the accumulator is int16, the activations fit in a byte and the output weights are int8,
+// so the output layer is a u8 x i8 dot product. Both layers have an AVX2 kernel, an SSE2 one and a scalar one, picked
+// when the network is created.
+namespace nnue {
+
+constexpr int INPUT_SIZE   = 768;
+constexpr int HIDDEN_SIZE  = 256;
+constexpr int QA           = 127; // activations are clipped to [0, QA], so a u8 x i8 pair sum cannot saturate an int16
+constexpr int QB           = 64;  // output weights are scaled by this
+constexpr int OUTPUT_SCALE = 400; // network output to centipawns
+
+// Weights file layout, all little endian: the magic, the version and the hidden size as uint32, then the feature
+// weights [INPUT_SIZE][HIDDEN_SIZE] and biases [HIDDEN_SIZE] as int16, the output weights [HIDDEN_SIZE] as int8 and
+// the output bias as int32
+constexpr uint32_t FILE_MAGIC   = 0x4e4e4842; // "BHNN"
+constexpr uint32_t FILE_VERSION = 1;
+
+enum class SimdLevel {
+    SCALAR,
+    SSE2,
+    AVX2
+};
+
+inline int feature_index(PieceType type, Color color, int square) {
+    return ((color == Color::WHITE ? 0 : 6) + int(type) - 1) * 64 + square;
+}
+
+struct alignas(64) accumulator_t {
+    int16_t values[HIDDEN_SIZE];
+};
+
+// The inputs a move switched off and on. Castling moves two pieces, a capture removes two
+struct feature_delta_t {
+    int removed_count = 0;
+    int added_count   = 0;
+    int removed[2]    = {};
+    int added[2]      = {};
+};
+
+// Call right after moves::make_move, with the piece it returned
+feature_delta_t move_delta(const bitboard_t& board, const bitboard_move_t& move, const piece_t& captured_piece) {
+    feature_delta_t delta;
+    int from_idx     = __builtin_ctzll(move.from_board);
+    int to_idx       = __builtin_ctzll(move.to_board);
+    piece_t moved    = board.at(to_idx % 8, to_idx / 8).piece;
+    PieceType before = (move.promotion_type != PieceType::EMPTY) ? PieceType::PAWN : moved.type;
+
+    delta.removed[delta.removed_count++] = feature_index(before, moved.color, from_idx);
+    delta.added[delta.added_count++]     = feature_index(moved.type, moved.color, to_idx);
+
+    if (captured_piece.type != PieceType::EMPTY) {
+        // En passant is the only capture that does not take on the destination square
+        int captured_idx = to_idx;
+        if (moved.type == PieceType::PAWN && (board.state_history.back().en_passant_square & move.to_board)) {
+            captured_idx = (from_idx / 8) * 8 + to_idx % 8;
+        }
+        delta.removed[delta.removed_count++] = feature_index(captured_piece.type, captured_piece.color, captured_idx);
+    } else if (moved.type == PieceType::KING && abs(to_idx % 8 - from_idx % 8) == 2) {
+        int rank          = from_idx / 8;
+        bool is_king_side = to_idx % 8 == 6;
+        delta.removed[delta.removed_count++] = feature_index(PieceType::ROOK, moved.color, rank * 8 + (is_king_side ? 7 : 0));
+        delta.added[delta.added_count++]     = feature_index(PieceType::ROOK, moved.color, rank * 8 + (is_king_side ? 5 : 3));
+    }
+    return delta;
+}
+
+// ---- KERNELS ----
+
+// out = in + the added rows - the removed rows
+void update_scalar(const int16_t* in, int16_t* out, const int16_t* const* added, int added_count,
+                   const int16_t* const* removed, int removed_count) {
+    for (int i = 0; i < HIDDEN_SIZE; i++) {
+        int value = in[i];
+        for (int j = 0; j < added_count; j++) {
+            value += added[j][i];
+        }
+        for (int j = 0; j < removed_count; j++) {
+            value -= removed[j][i];
+        }
+        out[i] = int16_t(value);
+    }
+}
+
+int32_t output_scalar(const int16_t* accumulator, const int8_t* weights) {
+    int32_t sum = 0;
+    for (int i = 0; i < HIDDEN_SIZE; i++) {
+        sum += clamp(int(accumulator[i]), 0, QA) * weights[i];
+    }
+    return sum;
+}
+
+#ifdef NNUE_X86
+void update_sse2(const int16_t* in, int16_t* out, const int16_t* const* added, int added_count,
+                 const int16_t* const* removed, int removed_count) {
+    for (int i = 0; i < HIDDEN_SIZE; i += 8) {
+        __m128i value = _mm_load_si128((const __m128i*)(in + i));
+        for (int j = 0; j < added_count; j++) {
+            value = _mm_add_epi16(value, _mm_load_si128((const __m128i*)(added[j] + i)));
+        }
+        for (int j = 0; j < removed_count; j++) {
+            value = _mm_sub_epi16(value, _mm_load_si128((const __m128i*)(removed[j] + i)));
+        }
+        _mm_store_si128((__m128i*)(out + i), value);
+    }
+}
+
+// SSE2 has no u8 x i8 multiply, so this one works on the int16 copy of the output weights
+int32_t output_sse2(const int16_t* accumulator, const int16_t* weights) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i qa   = _mm_set1_epi16(QA);
+    __m128i sum        = _mm_setzero_si128();
+    for (int i = 0; i < HIDDEN_SIZE; i += 8) {
+        __m128i value = _mm_load_si128((const __m128i*)(accumulator + i));
+        value         = _mm_min_epi16(_mm_max_epi16(value, zero), qa);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(value, _mm_load_si128((const __m128i*)(weights + i))));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2"))) void update_avx2(const int16_t* in, int16_t* out, const int16_t* const* added,
+                                                 int added_count, const int16_t* const* removed, int removed_count) {
+    for (int i = 0; i < HIDDEN_SIZE; i += 16) {
+        __m256i value = _mm256_load_si256((const __m256i*)(in + i));
+        for (int j = 0; j < added_count; j++) {
+            value = _mm256_add_epi16(value, _mm256_load_si256((const __m256i*)(added[j] + i)));
+        }
+        for (int j = 0; j < removed_count; j++) {
+            value = _mm256_sub_epi16(value, _mm256_load_si256((const __m256i*)(removed[j] + i)));
+        }
+        _mm256_store_si256((__m256i*)(out + i), value);
+    }
+}
+
+__attribute__((target("avx2"))) int32_t output_avx2(const int16_t* accumulator, const int8_t* weights) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i qa   = _mm256_set1_epi16(QA);
+    const __m256i ones = _mm256_set1_epi16(1);
+    __m256i sum        = _mm256_setzero_si256();
+    for (int i = 0; i < HIDDEN_SIZE; i += 32) {
+        __m256i low  = _mm256_load_si256((const __m256i*)(accumulator + i));
+        __m256i high = _mm256_load_si256((const __m256i*)(accumulator + i + 16));
+        low          = _mm256_min_epi16(_mm256_max_epi16(low, zero), qa);
+        high         = _mm256_min_epi16(_mm256_max_epi16(high, zero), qa);
+
+        // Packing works per 128 bit lane, the permute puts the 32 activations back in order
+        __m256i activations = _mm256_permute4x64_epi64(_mm256_packus_epi16(low, high), _MM_SHUFFLE(3, 1, 2, 0));
+        __m256i products    = _mm256_maddubs_epi16(activations, _mm256_load_si256((const __m256i*)(weights + i)));
+        sum                 = _mm256_add_epi32(sum, _mm256_madd_epi16(products, ones));
+    }
+    __m128i half = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    half         = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(1, 0, 3, 2)));
+    half         = _mm_add_epi32(half, _mm_shuffle_epi32(half, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(half);
+}
+#endif
+
+SimdLevel best_simd_level() {
+#ifdef NNUE_X86
+    return __builtin_cpu_supports("avx2") ? SimdLevel::AVX2 : SimdLevel::SSE2;
+#else
+    return SimdLevel::SCALAR;
+#endif
+}
+
+const char* simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::AVX2: return "AVX2";
+        case SimdLevel::SSE2: return "SSE2";
+        default: return "scalar";
+    }
+}
+
+// ---- NETWORK ----
+
+// About 400KB, so keep it on the heap. Read only once loaded, all threads share one
+struct network_t {
+    alignas(64) int16_t feature_weights[INPUT_SIZE][HIDDEN_SIZE];
+    alignas(64) int16_t feature_bias[HIDDEN_SIZE];
+    alignas(64) int8_t output_weights[HIDDEN_SIZE];
+    alignas(64) int16_t output_weights_wide[HIDDEN_SIZE]; // the same weights, for the SSE2 kernel
+    int32_t output_bias = 0;
+    SimdLevel simd      = best_simd_level(); // may be lowered to compare the kernels, never raised
+
+    // Returns false and says why if the file is missing, truncated or made for a different network
+    bool load(const string& path, string& error) {
+        ifstream file(path, ios::binary);
+        if (!file) {
+            error = "cannot open " + path;
+            return false;
+        }
+
+        uint32_t header[3];
+        file.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!file || header[0] != FILE_MAGIC || header[1] != FILE_VERSION) {
+            error = path + " is not a weights file of this version";
+            return false;
+        }
+        if (header[2] != HIDDEN_SIZE) {
+            error = path + " has " + to_string(header[2]) + " hidden neurons, expected " + to_string(HIDDEN_SIZE);
+            return false;
+        }
+
+        file.read(reinterpret_cast<char*>(feature_weights), sizeof(feature_weights));
+        file.read(reinterpret_cast<char*>(feature_bias), sizeof(feature_bias));
+        file.read(reinterpret_cast<char*>(output_weights), sizeof(output_weights));
+        file.read(reinterpret_cast<char*>(&output_bias), sizeof(output_bias));
+        if (!file || file.peek() != EOF) {
+            error = path + " does not have the expected size";
+            return false;
+        }
+
+        for (int i = 0; i < HIDDEN_SIZE; i++) {
+            output_weights_wide[i] = output_weights[i];
+        }
+        return true;
+    }
+
+    bool save(const string& path) const {
+        ofstream file(path, ios::binary);
+        uint32_t header[3] = {FILE_MAGIC, FILE_VERSION, HIDDEN_SIZE};
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(feature_weights), sizeof(feature_weights));
+        file.write(reinterpret_cast<const char*>(feature_bias), sizeof(feature_bias));
+        file.write(reinterpret_cast<const char*>(output_weights), sizeof(output_weights));
+        file.write(reinterpret_cast<const char*>(&output_bias), sizeof(output_bias));
+        return bool(file);
+    }
+
+    void update(const accumulator_t& parent, const feature_delta_t& delta, accumulator_t& child) const {
+        const int16_t* added[2]   = {};
+        const int16_t* removed[2] = {};
+        for (int i = 0; i < delta.added_count; i++) {
+            added[i] = feature_weights[delta.added[i]];
+        }
+        for (int i = 0; i < delta.removed_count; i++) {
+            removed[i] = feature_weights[delta.removed[i]];
+        }
+
+        switch (simd) {
+#ifdef NNUE_X86
+            case SimdLevel::AVX2:
+                update_avx2(parent.values, child.values, added, delta.added_count, removed, delta.removed_count);
+                break;
+            case SimdLevel::SSE2:
+                update_sse2(parent.values, child.values, added, delta.added_count, removed, delta.removed_count);
+                break;
+#endif
+            default:
+                update_scalar(parent.values, child.values, added, delta.added_count, removed, delta.removed_count);
+        }
+    }
+
+    // Builds the accumulator from scratch, one piece at a time
+    void refresh(const bitboard_t& board, accumulator_t& accumulator) const {
+        const pair<U64, piece_t> pieces[12] = {
+            {board.board_w_P, {PieceType::PAWN, Color::WHITE}},   {board.board_w_N, {PieceType::KNIGHT, Color::WHITE}},
+            {board.board_w_B, {PieceType::BISHOP, Color::WHITE}}, {board.board_w_R, {PieceType::ROOK, Color::WHITE}},
+            {board.board_w_Q, {PieceType::QUEEN, Color::WHITE}},  {board.board_w_K, {PieceType::KING, Color::WHITE}},
+            {board.board_b_P, {PieceType::PAWN, Color::BLACK}},   {board.board_b_N, {PieceType::KNIGHT, Color::BLACK}},
+            {board.board_b_B, {PieceType::BISHOP, Color::BLACK}}, {board.board_b_R, {PieceType::ROOK, Color::BLACK}},
+            {board.board_b_Q, {PieceType::QUEEN, Color::BLACK}},  {board.board_b_K, {PieceType::KING, Color::BLACK}},
+        };
+
+        memcpy(accumulator.values, feature_bias, sizeof(feature_bias));
+        for (const auto& [bitboard, piece] : pieces) {
+            U64 remaining = bitboard;
+            while (remaining) {
+                feature_delta_t delta;
+                delta.added[delta.added_count++] = feature_index(piece.type, piece.color, __builtin_ctzll(remaining));
+                update(accumulator, delta, accumulator);
+                remaining &= remaining - 1;
+            }
+        }
+    }
+
+    // In centipawns, from white's perspective like every other evaluation
+    int evaluate(const accumulator_t& accumulator) const {
+        int32_t sum;
+        switch (simd) {
+#ifdef NNUE_X86
+            case SimdLevel::AVX2: sum = output_avx2(accumulator.values, output_weights); break;
+            case SimdLevel::SSE2: sum = output_sse2(accumulator.values, output_weights_wide); break;
+#endif
+            default: sum = output_scalar(accumulator.values, output_weights);
+        }
+        return int((int64_t(sum) + output_bias) * OUTPUT_SCALE / (QA * QB));
+    }
+};
+
+} // namespace nnue
+
+#endif
@@ -0,0 +1,961 @@
+#ifndef syzygy_hpp
+#define syzygy_hpp
+
+#include "board_t.hpp"
+#include "moves.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// Syzygy endgame tablebases: win/draw/loss (.rtbw) and distance to zeroing (.rtbz, plies until the next capture or pawn
+// move) for positions with at most 6 pieces, kings included. The files are memory mapped on the first probe of each
+// table, only the pages that are actually read ever get loaded.
+//
+// A table is a list of compressed blocks. A position is turned into an index by placing its pieces on the board in a
+// fixed order, using the symmetries of the board to leave out mirrored positions, and the value at that index is
+// found by decoding the Huffman coded symbols of its block. This follows the layout of the reference prober by Ronald
+// de Man, as used in most engines.
+namespace syzygy {
+
+constexpr int MAX_PIECES = 6;
+
+// From the side to move. Cursed wins and blessed losses are wins and losses that take too long, the fifty move rule
+// turns them into draws
+enum wdl_t { LOSS = -2, BLESSED_LOSS = -1, DRAW = 0, CURSED_WIN = 1, WIN = 2 };
+
+enum probe_state_t {
+    FAIL              = 0, // no table, or the table could not be read
+    OK                = 1,
+    CHANGE_STM        = -1, // the DTZ table only stores the other side to move
+    ZEROING_BEST_MOVE = 2  // the best move is a capture or pawn move
+};
+
+// Flags per table (and per pawn file)
+constexpr uint8_t FLAG_STM          = 1;
+constexpr uint8_t FLAG_MAPPED       = 2;
+constexpr uint8_t FLAG_WIN_PLIES    = 4;
+constexpr uint8_t FLAG_LOSS_PLIES   = 8;
+constexpr uint8_t FLAG_WIDE         = 16;
+constexpr uint8_t FLAG_SINGLE_VALUE = 128;
+
+constexpr uint8_t WDL_MAGIC[4] = {0x71, 0xE8, 0x23, 0x5D};
+constexpr uint8_t DTZ_MAGIC[4] = {0xD7, 0x66, 0x0C, 0xA5};
+
+// Pieces as stored in the files: the piece type (PAWN = 1 .. KING = 6, as in PieceType), plus 8 for black
+constexpr int BLACK_PIECE = 8;
+
+// ---- INDEXING ----
+
+// Distance of a square above (positive) or below (negative) the a1-h8 diagonal
+constexpr int off_diagonal(int square) {
+    return square / 8 - square % 8;
+}
+
+// Counting tables for turning a placement of pieces into an index, all from the reference implementation
+struct index_tables_t {
+    int map_b1h1h7[64]          = {}; // squares below the diagonal to 0..27
+    int map_a1d1d4[64]          = {}; // the a1-d1-d4 triangle to 0..9, the diagonal last
+    int map_kk[10][64]          = {}; // legal placements of two kings, the first in the triangle, to 0..461
+    U64 binomial[6][64]         = {};
+    int map_pawns[64]           = {}; // a2..h7 to 47..0, the edge files and the low ranks first
+    int lead_pawn_idx[6][64]    = {}; // by number of leading pawns and the square of the first
+    int lead_pawns_size[6][4]   = {}; // by number of leading pawns and file
+    int kk_placements           = 0;
+
+    constexpr index_tables_t() {
+        int code = 0;
+        for (int square = 0; square < 64; square++) {
+            if (off_diagonal(square) < 0) {
+                map_b1h1h7[square] = code++;
+            }
+        }
+
+        // a1-d4 triangle below the diagonal first, then the 4 diagonal squares
+        code = 0;
+        for (int pass = 0; pass < 2; pass++) {
+            for (int rank = 0; rank < 4; rank++) {
+                for (int file = 0; file < 4; file++) {
+                    int square = rank * 8 + file;
+                    if ((pass == 0 && off_diagonal(square) < 0) || (pass == 1 && off_diagonal(square) == 0)) {
+                        map_a1d1d4[square] = code++;
+                    }
+                }
+            }
+        }
+
+        // Kings that are both on the diagonal come last
+        int both_on_diagonal[64][2] = {};
+        int diagonal_count          = 0;
+        code                        = 0;
+        for (int idx = 0; idx < 10; idx++) {
+            for (int first = 0; first < 28; first++) {
+                if (first % 8 > 3 || map_a1d1d4[first] != idx || (idx == 0 && first != 1)) {
+                    continue; // b1 is the one square that maps to 0
+                }
+                for (int second = 0; second < 64; second++) {
+                    int file_distance = first % 8 > second % 8 ? first % 8 - second % 8 : second % 8 - first % 8;
+                    int rank_distance = first / 8 > second / 8 ? first / 8 - second / 8 : second / 8 - first / 8;
+                    if (file_distance <= 1 && rank_distance <= 1) {
+                        continue; // touching or on the same square
+                    }
+                    if (off_diagonal(first) == 0 && off_diagonal(second) > 0) {
+                        continue; // mirrored below the diagonal
+                    }
+                    if (off_diagonal(first) == 0 && off_diagonal(second) == 0) {
+                        both_on_diagonal[diagonal_count][0] = idx;
+                        both_on_diagonal[diagonal_count][1] = second;
+                        diagonal_count++;
+                    } else {
+                        map_kk[idx][second] = code++;
+                    }
+                }
+            }
+        }
+        for (int i = 0; i < diagonal_count; i++) {
+            map_kk[both_on_diagonal[i][0]][both_on_diagonal[i][1]] = code++;
+        }
+        kk_placements = code;
+
+        binomial[0][0] = 1;
+        for (int n = 1; n < 64; n++) {
+            for (int k = 0; k < 6 && k <= n; k++) {
+                binomial[k][n] = (k > 0 ? binomial[k - 1][n - 1] : 0) + (k < n ? binomial[k][n - 1] : 0);
+            }
+        }
+
+        int available = 47;
+        for (int lead_count = 1; lead_count <= 5; lead_count++) {
+            for (int file = 0; file < 4; file++) {
+                int idx = 0;
+                for (int rank = 1; rank <= 6; rank++) {
+                    int square = rank * 8 + file;
+                    if (lead_count == 1) {
+                        map_pawns[square]     = available--;
+                        map_pawns[square ^ 7] = available--;
+                    }
+                    lead_pawn_idx[lead_count][square] = idx;
+                    idx += int(binomial[lead_count - 1][map_pawns[square]]);
+                }
+                lead_pawns_size[lead_count][file] = idx;
+            }
+        }
+    }
+};
+
+constexpr index_tables_t INDEX = index_tables_t();
+
+// ---- FILE FORMAT ----
+
+inline uint16_t read_le16(const uint8_t* data) {
+    return uint16_t(data[0] | (data[1] << 8));
+}
+
+inline uint32_t read_le32(const uint8_t* data) {
+    return uint32_t(data[0]) | (uint32_t(data[1]) << 8) | (uint32_t(data[2]) << 16) | (uint32_t(data[3]) << 24);
+}
+
+inline uint32_t read_be32(const uint8_t* data) {
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+inline U64 read_be64(const uint8_t* data) {
+    return (U64(read_be32(data)) << 32) | read_be32(data + 4);
+}
+
+// A symbol of the pairing tree takes 3 bytes: two 12 bit children, or 0xFFF on the right for a leaf, whose value is
+// then on the left
+inline int tree_left(const uint8_t* node) {
+    return ((node[1] & 0xF) << 8) | node[0];
+}
+
+inline int tree_right(const uint8_t* node) {
+    return (node[2] << 4) | (node[1] >> 4);
+}
+
+// The compressed values of one side to move and pawn file. Symbols are canonical Huffman codes, and every symbol
+// stands for a pair of symbols, recursively, so one symbol can expand to many values.
+struct pairs_data_t {
+    uint8_t flags        = 0;
+    int min_sym_len      = 0; // the value itself for single value tables
+    int max_sym_len      = 0;
+    U64 block_size       = 0; // in bytes
+    U64 span             = 0; // values per sparse index entry
+    uint32_t num_blocks  = 0;
+    size_t sparse_count  = 0;
+    size_t block_lengths = 0;
+    const uint8_t* lowest_sym   = nullptr; // per code length, little endian 16 bit
+    const uint8_t* tree         = nullptr; // 3 bytes per symbol
+    const uint8_t* sparse_index = nullptr; // 6 bytes per entry: first block, offset into it
+    const uint8_t* block_length = nullptr; // values in a block - 1, little endian 16 bit
+    const uint8_t* data         = nullptr;
+    vector<U64> base64;                     // lowest code of each length, left aligned
+    vector<uint8_t> symlen;                 // values a symbol expands to - 1
+    uint8_t pieces[MAX_PIECES] = {};        // the order in which the pieces are indexed
+    U64 group_idx[MAX_PIECES + 1]  = {};
+    int group_len[MAX_PIECES + 1]  = {};
+    uint16_t map_idx[4]            = {}; // DTZ only, where the value map for each result starts
+};
+
+struct table_t {
+    bool dtz = false;
+    string path;
+    U64 key       = 0; // material key with the first side of the name as white
+    U64 key2      = 0; // and as black
+    int piece_count = 0;
+    bool has_pawns  = false;
+    bool has_unique_pieces = false;
+    uint8_t pawn_count[2]  = {}; // the leading color first
+    pairs_data_t items[2][4];    // by side to move and pawn file
+    const uint8_t* map = nullptr; // DTZ values by result
+
+    atomic<bool> ready{false}; // set once mapping was tried, base stays null if that failed
+    mutex map_mutex;
+    void* base  = nullptr;
+    size_t size = 0;
+
+    ~table_t() {
+        if (base != nullptr) {
+            munmap(base, size);
+        }
+    }
+
+    bool symmetric() const {
+        return key == key2;
+    }
+
+    int sides() const {
+        return !dtz && !symmetric() ? 2 : 1;
+    }
+
+    pairs_data_t& get(int stm, int file) {
+        return items[stm % sides()][has_pawns ? file : 0];
+    }
+};
+
+// Pieces of a name like "KRPvKR", types in the order of the file names
+constexpr char NAME_ORDER[] = "QRBNP";
+constexpr PieceType NAME_TYPES[] = {PieceType::QUEEN, PieceType::ROOK, PieceType::BISHOP, PieceType::KNIGHT,
+                                    PieceType::PAWN};
+
+// Parses a table name, false if it is not one
+inline bool parse_name(const string& name, int counts[2][6]) {
+    size_t split = name.find('v');
+    if (split == string::npos || name.size() < 4 || name[0] != 'K' || name[split + 1] != 'K') {
+        return false;
+    }
+    for (int side = 0; side < 2; side++) {
+        string part = side == 0 ? name.substr(1, split - 1) : name.substr(split + 2);
+        for (char c : part) {
+            const char* found = strchr(NAME_ORDER, c);
+            if (found == nullptr || c == '\0') {
+                return false;
+            }
+            counts[side][int(NAME_TYPES[found - NAME_ORDER])]++;
+        }
+    }
+    return true;
+}
+
+inline U64 material_key(const int counts[2][6], int white) {
+    U64 key = 0;
+    for (PieceType type : NAME_TYPES) {
+        key += counts[white][int(type)] * bitboard_t::material_unit(type, Color::WHITE);
+        key += counts[1 - white][int(type)] * bitboard_t::material_unit(type, Color::BLACK);
+    }
+    return key;
+}
+
+// Number of pieces in each group, and what an index in each group is multiplied by. The leading group is the kings
+// (and a third unique piece if there is one) or the leading pawns. order[] tells in which order the groups come.
+inline void set_groups(const table_t& table, pairs_data_t& d, const int order[2], int file) {
+    int n = 0, first_len = table.has_pawns ? 0 : table.has_unique_pieces ? 3 : 2;
+    d.group_len[n] = 1;
+    for (int i = 1; i < table.piece_count; i++) {
+        if (--first_len > 0 || d.pieces[i] == d.pieces[i - 1]) {
+            d.group_len[n]++;
+        } else {
+            d.group_len[++n] = 1;
+        }
+    }
+    d.group_len[++n] = 0;
+
+    bool both_pawns  = table.has_pawns && table.pawn_count[1];
+    int next         = both_pawns ? 2 : 1;
+    int free_squares = 64 - d.group_len[0] - (both_pawns ? d.group_len[1] : 0);
+    U64 idx          = 1;
+    for (int k = 0; next < n || k == order[0] || k == order[1]; k++) {
+        if (k == order[0]) {
+            d.group_idx[0] = idx;
+            idx *= table.has_pawns           ? INDEX.lead_pawns_size[d.group_len[0]][file]
+                   : table.has_unique_pieces ? 31332
+                                             : 462;
+        } else if (k == order[1]) {
+            d.group_idx[1] = idx;
+            idx *= INDEX.binomial[d.group_len[1]][48 - d.group_len[0]];
+        } else {
+            d.group_idx[next] = idx;
+            idx *= INDEX.binomial[d.group_len[next]][free_squares];
+            free_squares -= d.group_len[next++];
+        }
+    }
+    d.group_idx[n] = idx;
+}
+
+inline uint8_t set_symlen(pairs_data_t& d, int symbol, vector<bool>& visited) {
+    visited[symbol] = true;
+    const uint8_t* node = d.tree + 3 * symbol;
+    int right           = tree_right(node);
+    if (right == 0xFFF) {
+        return 0;
+    }
+    int left = tree_left(node);
+    if (!visited[left]) {
+        d.symlen[left] = set_symlen(d, left, visited);
+    }
+    if (!visited[right]) {
+        d.symlen[right] = set_symlen(d, right, visited);
+    }
+    return d.symlen[left] + d.symlen[right] + 1;
+}
+
+// Reads the Huffman code and block layout of one pairs_data_t, returns where the next one starts
+inline const uint8_t* set_sizes(pairs_data_t& d, const uint8_t* data) {
+    d.flags = *data++;
+    if (d.flags & FLAG_SINGLE_VALUE) {
+        d.min_sym_len = *data++;
+        return data;
+    }
+
+    int groups = 0;
+    while (d.group_len[groups] != 0) {
+        groups++;
+    }
+    U64 table_size  = d.group_idx[groups];
+    d.block_size    = 1ULL << *data++;
+    d.span          = 1ULL << *data++;
+    d.sparse_count  = size_t((table_size + d.span - 1) / d.span);
+    int padding     = *data++;
+    d.num_blocks    = read_le32(data);
+    data += 4;
+    d.block_lengths = d.num_blocks + padding; // so the sparse index never points past the end
+    d.max_sym_len   = *data++;
+    d.min_sym_len   = *data++;
+    d.lowest_sym    = data;
+
+    // Longer codes have lower values, base64[i] is the lowest code of length min_sym_len + i, shifted to the top
+    d.base64.assign(d.max_sym_len - d.min_sym_len + 1, 0);
+    for (int i = int(d.base64.size()) - 2; i >= 0; i--) {
+        d.base64[i] = (d.base64[i + 1] + read_le16(d.lowest_sym + 2 * i) - read_le16(d.lowest_sym + 2 * (i + 1))) / 2;
+    }
+    for (size_t i = 0; i < d.base64.size(); i++) {
+        d.base64[i] <<= 64 - i - d.min_sym_len;
+    }
+    data += 2 * d.base64.size();
+
+    d.symlen.assign(read_le16(data), 0);
+    data += 2;
+    d.tree = data;
+    vector<bool> visited(d.symlen.size());
+    for (size_t symbol = 0; symbol < d.symlen.size(); symbol++) {
+        if (!visited[symbol]) {
+            d.symlen[symbol] = set_symlen(d, int(symbol), visited);
+        }
+    }
+    return data + 3 * d.symlen.size() + (d.symlen.size() & 1);
+}
+
+// DTZ values are stored as small numbers that a map per result turns into the real distances
+inline const uint8_t* set_dtz_map(table_t& table, const uint8_t* data, int max_file) {
+    table.map = data;
+    for (int file = 0; file <= max_file; file++) {
+        pairs_data_t& d = table.get(0, file);
+        if (!(d.flags & FLAG_MAPPED)) {
+            continue;
+        }
+        if (d.flags & FLAG_WIDE) {
+            data += (data - table.map) & 1;
+            for (int i = 0; i < 4; i++) {
+                d.map_idx[i] = uint16_t((data - table.map) / 2 + 1);
+                data += 2 * read_le16(data) + 2;
+            }
+        } else {
+            for (int i = 0; i < 4; i++) {
+                d.map_idx[i] = uint16_t(data - table.map + 1);
+                data += *data + 1;
+            }
+        }
+    }
+    return data + ((data - table.map) & 1);
+}
+
+// Fills in everything that follows the magic number
+inline bool parse_table(table_t& table, const uint8_t* base) {
+    const uint8_t* data = base + 4;
+    const uint8_t* end  = base + table.size;
+    if ((bool(*data & 2) != table.has_pawns) || (bool(*data & 1) != !table.symmetric())) {
+        return false; // the file does not match its name
+    }
+    data++;
+
+    int sides       = table.sides();
+    int max_file    = table.has_pawns ? 3 : 0;
+    bool both_pawns = table.has_pawns && table.pawn_count[1];
+    for (int file = 0; file <= max_file; file++) {
+        int order[2][2] = {{*data & 0xF, both_pawns ? *(data + 1) & 0xF : 0xF},
+                           {*data >> 4, both_pawns ? *(data + 1) >> 4 : 0xF}};
+        data += 1 + both_pawns;
+        for (int k = 0; k < table.piece_count; k++, data++) {
+            for (int i = 0; i < sides; i++) {
+                table.items[i][file].pieces[k] = uint8_t(i ? *data >> 4 : *data & 0xF);
+            }
+        }
+        for (int i = 0; i < sides; i++) {
+            set_groups(table, table.items[i][file], order[i], file);
+        }
+    }
+    data += (data - base) & 1;
+
+    for (int file = 0; file <= max_file; file++) {
+        for (int i = 0; i < sides; i++) {
+            data = set_sizes(table.items[i][file], data);
+            if (data > end) {
+                return false;
+            }
+        }
+    }
+    if (table.dtz) {
+        data = set_dtz_map(table, data, max_file);
+    }
+    for (int file = 0; file <= max_file; file++) {
+        for (int i = 0; i < sides; i++) {
+            table.items[i][file].sparse_index = data;
+            data += 6 * table.items[i][file].sparse_count;
+        }
+    }
+    for (int file = 0; file <= max_file; file++) {
+        for (int i = 0; i < sides; i++) {
+            table.items[i][file].block_length = data;
+            data += 2 * table.items[i][file].block_lengths;
+        }
+    }
+    for (int file = 0; file <= max_file; file++) {
+        for (int i = 0; i < sides; i++) {
+            data += (64 - (data - base) % 64) % 64;
+            table.items[i][file].data = data;
+            data += U64(table.items[i][file].num_blocks) * table.items[i][file].block_size;
+        }
+    }
+    return data <= end;
+}
+
+// Maps the file of a table on first use. Other threads may probe the same table at the same time, so the mapping is
+// done under a lock, and the flag tells the others it is done
+inline bool map_table(table_t& table) {
+    if (table.ready.load(memory_order_acquire)) {
+        return table.base != nullptr;
+    }
+    lock_guard<mutex> lock(table.map_mutex);
+    if (table.ready.load(memory_order_relaxed)) {
+        return table.base != nullptr;
+    }
+
+    int fd = open(table.path.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd != -1 && fstat(fd, &info) == 0 && info.st_size % 64 == 16) {
+        void* base = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (base != MAP_FAILED) {
+            table.base = base;
+            table.size = info.st_size;
+        }
+    }
+    if (fd != -1) {
+        close(fd);
+    }
+
+    const uint8_t* magic = table.dtz ? DTZ_MAGIC : WDL_MAGIC;
+    if (table.base != nullptr &&
+        (memcmp(table.base, magic, 4) != 0 || !parse_table(table, static_cast<const uint8_t*>(table.base)))) {
+        munmap(table.base, table.size);
+        table.base = nullptr;
+    }
+    table.ready.store(true, memory_order_release);
+    return table.base != nullptr;
+}
+
+// The value at an index: find the block through the sparse index, then walk its symbols until the one that covers
+// the index, and finally descend the pairing tree to the value itself
+inline int decompress_pairs(const pairs_data_t& d, U64 idx) {
+    if (d.flags & FLAG_SINGLE_VALUE) {
+        return d.min_sym_len;
+    }
+
+    uint32_t k     = uint32_t(idx / d.span);
+    uint32_t block = read_le32(d.sparse_index + 6 * k);
+    int offset     = read_le16(d.sparse_index + 6 * k + 4);
+    offset += int(idx % d.span) - int(d.span / 2);
+
+    while (offset < 0) {
+        offset += read_le16(d.block_length + 2 * --block) + 1;
+    }
+    while (offset > read_le16(d.block_length + 2 * block)) {
+        offset -= read_le16(d.block_length + 2 * block++) + 1;
+    }
+
+    const uint8_t* ptr = d.data + U64(block) * d.block_size;
+    U64 buffer         = read_be64(ptr);
+    int buffer_size    = 64;
+    ptr += 8;
+    int symbol;
+    while (true) {
+        int len = 0;
+        while (buffer < d.base64[len]) {
+            len++;
+        }
+        symbol = int((buffer - d.base64[len]) >> (64 - len - d.min_sym_len));
+        symbol += read_le16(d.lowest_sym + 2 * len);
+        if (offset < d.symlen[symbol] + 1) {
+            break;
+        }
+        offset -= d.symlen[symbol] + 1;
+        len += d.min_sym_len;
+        buffer <<= len;
+        buffer_size -= len;
+        if (buffer_size <= 32) {
+            buffer_size += 32;
+            buffer |= U64(read_be32(ptr)) << (64 - buffer_size);
+            ptr += 4;
+        }
+    }
+
+    while (d.symlen[symbol]) {
+        int left = tree_left(d.tree + 3 * symbol);
+        if (offset < d.symlen[left] + 1) {
+            symbol = left;
+        } else {
+            offset -= d.symlen[left] + 1;
+            symbol = tree_right(d.tree + 3 * symbol);
+        }
+    }
+    return tree_left(d.tree + 3 * symbol);
+}
+
+// Stored DTZ to plies, counted from the position itself
+inline int map_dtz(table_t& table, int file, int value, wdl_t wdl) {
+    constexpr int WDL_MAP[] = {1, 3, 0, 2, 0};
+    const pairs_data_t& d   = table.get(0, file);
+    if (d.flags & FLAG_MAPPED) {
+        int start = d.map_idx[WDL_MAP[wdl + 2]];
+        value     = (d.flags & FLAG_WIDE) ? read_le16(table.map + 2 * (start + value)) : table.map[start + value];
+    }
+    if ((wdl == WIN && !(d.flags & FLAG_WIN_PLIES)) || (wdl == LOSS && !(d.flags & FLAG_LOSS_PLIES)) ||
+        wdl == CURSED_WIN || wdl == BLESSED_LOSS) {
+        value *= 2;
+    }
+    return value + 1;
+}
+
+inline bool pawn_before(int a, int b) {
+    return INDEX.map_pawns[a] < INDEX.map_pawns[b];
+}
+
+// Looks up a position in a mapped table: WDL, or DTZ in plies when wdl is the known result
+inline int probe_table(const bitboard_t& board, table_t& table, wdl_t wdl, probe_state_t& state) {
+    int squares[MAX_PIECES] = {};
+    int pieces[MAX_PIECES]  = {};
+    int size = 0, lead_count = 0, file = 0;
+    U64 lead_pawns = 0;
+
+    // Tables are stored with the stronger side as white, and symmetric tables with white to move only. Anything else
+    // is looked up with the colors swapped and the board flipped
+    bool black_to_move = board.active_color == Color::BLACK;
+    bool flip          = (table.symmetric() && black_to_move) || board.material_key != table.key;
+    int flip_color     = flip ? BLACK_PIECE : 0;
+    int flip_squares   = flip ? 56 : 0;
+    int stm            = flip != black_to_move;
+
+    const U64 bitboards[12] = {board.board_w_P, board.board_w_N, board.board_w_B, board.board_w_R,
+                               board.board_w_Q, board.board_w_K, board.board_b_P, board.board_b_N,
+                               board.board_b_B, board.board_b_R, board.board_b_Q, board.board_b_K};
+
+    // With pawns there is a table per file of the leading pawn, the one closest to the edge and the 2nd rank
+    if (table.has_pawns) {
+        bool black_leads = (table.get(0, 0).pieces[0] ^ flip_color) & BLACK_PIECE;
+        lead_pawns       = black_leads ? board.board_b_P : board.board_w_P;
+        for (U64 b = lead_pawns; b; b &= b - 1) {
+            squares[size++] = __builtin_ctzll(b) ^ flip_squares;
+        }
+        lead_count = size;
+        swap(squares[0], *max_element(squares, squares + lead_count, pawn_before));
+        file = min(squares[0] % 8, 7 - squares[0] % 8);
+    }
+
+    if (table.dtz && (table.get(stm, file).flags & FLAG_STM) != stm && !(table.symmetric() && !table.has_pawns)) {
+        state = CHANGE_STM;
+        return 0;
+    }
+
+    for (int i = 0; i < 12; i++) {
+        int piece = (i % 6 + 1) + (i >= 6 ? BLACK_PIECE : 0);
+        for (U64 b = bitboards[i] & ~lead_pawns; b; b &= b - 1) {
+            squares[size]  = __builtin_ctzll(b) ^ flip_squares;
+            pieces[size++] = piece ^ flip_color;
+        }
+    }
+    pairs_data_t& d = table.get(stm, file);
+
+    // Same order as in the table
+    for (int i = lead_count; i < size - 1; i++) {
+        for (int j = i + 1; j < size; j++) {
+            if (d.pieces[i] == pieces[j]) {
+                swap(pieces[i], pieces[j]);
+                swap(squares[i], squares[j]);
+                break;
+            }
+        }
+    }
+
+    // The leading piece goes to files a to d
+    if (squares[0] % 8 > 3) {
+        for (int i = 0; i < size; i++) {
+            squares[i] ^= 7;
+        }
+    }
+
+    U64 idx;
+    if (table.has_pawns) {
+        idx = INDEX.lead_pawn_idx[lead_count][squares[0]];
+        stable_sort(squares + 1, squares + lead_count, pawn_before);
+        for (int i = 1; i < lead_count; i++) {
+            idx += INDEX.binomial[i][INDEX.map_pawns[squares[i]]];
+        }
+    } else {
+        // Without pawns also to ranks 1 to 4, and below the a1-h8 diagonal
+        if (squares[0] / 8 > 3) {
+            for (int i = 0; i < size; i++) {
+                squares[i] ^= 56;
+            }
+        }
+        for (int i = 0; i < d.group_len[0]; i++) {
+            if (off_diagonal(squares[i]) == 0) {
+                continue;
+            }
+            if (off_diagonal(squares[i]) > 0) {
+                for (int j = i; j < size; j++) {
+                    squares[j] = ((squares[j] >> 3) | (squares[j] << 3)) & 63;
+                }
+            }
+            break;
+        }
+
+        if (table.has_unique_pieces) {
+            int adjust1 = squares[1] > squares[0];
+            int adjust2 = (squares[2] > squares[0]) + (squares[2] > squares[1]);
+            if (off_diagonal(squares[0])) {
+                idx = (INDEX.map_a1d1d4[squares[0]] * 63 + (squares[1] - adjust1)) * 62 + squares[2] - adjust2;
+            } else if (off_diagonal(squares[1])) {
+                idx = (6 * 63 + (squares[0] / 8) * 28 + INDEX.map_b1h1h7[squares[1]]) * 62 + squares[2] - adjust2;
+            } else if (off_diagonal(squares[2])) {
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + (squares[0] / 8) * 7 * 28 + (squares[1] / 8 - adjust1) * 28 +
+                      INDEX.map_b1h1h7[squares[2]];
+            } else {
+                idx = 6 * 63 * 62 + 4 * 28 * 62 + 4 * 7 * 28 + (squares[0] / 8) * 7 * 6 +
+                      (squares[1] / 8 - adjust1) * 6 + (squares[2] / 8 - adjust2);
+            }
+        } else {
+            idx = INDEX.map_kk[INDEX.map_a1d1d4[squares[0]]][squares[1]];
+        }
+    }
+
+    // The other groups, each as a combination of the squares left over by the groups before it
+    idx *= d.group_idx[0];
+    int* group         = squares + d.group_len[0];
+    bool remaining_pawns = table.has_pawns && table.pawn_count[1];
+    for (int next = 1; d.group_len[next]; next++) {
+        stable_sort(group, group + d.group_len[next]);
+        U64 n = 0;
+        for (int i = 0; i < d.group_len[next]; i++) {
+            int adjust = int(count_if(squares, group, [&](int square) { return group[i] > square; }));
+            n += INDEX.binomial[i + 1][group[i] - adjust - 8 * remaining_pawns];
+        }
+        remaining_pawns = false;
+        idx += n * d.group_idx[next];
+        group += d.group_len[next];
+    }
+
+    int value = decompress_pairs(d, idx);
+    return table.dtz ? map_dtz(table, file, value, wdl) : value - 2;
+}
+
+// DTZ right before a capture or pawn move that reaches the given result
+inline int dtz_before_zeroing(wdl_t wdl) {
+    return wdl == WIN ? 1 : wdl == CURSED_WIN ? 101 : wdl == BLESSED_LOSS ? -101 : wdl == LOSS ? -1 : 0;
+}
+
+inline int sign(int value) {
+    return (value > 0) - (value < 0);
+}
+
+inline bool is_capture(const bitboard_t& board, const bitboard_move_t& move, Color color) {
+    U64 pawns = board.board_w_P | board.board_b_P;
+    return (move.to_board & board.get_all_friendly_pieces(!color)) ||
+           ((move.to_board & board.en_passant_square) && (move.from_board & pawns));
+}
+
+class tablebases_t {
+  public:
+    int max_pieces  = 0; // of the largest table found
+    int probe_limit = 0; // the search probes at this many pieces or fewer
+
+    // Registers the tables found in a directory, the files are only opened when probed. Returns how many WDL tables
+    // there are
+    size_t init(const string& directory) {
+        DIR* dir = opendir(directory.c_str());
+        if (dir == nullptr) {
+            return 0;
+        }
+        vector<string> names;
+        while (dirent* entry = readdir(dir)) {
+            string file = entry->d_name;
+            if (file.size() > 5 && file.substr(file.size() - 5) == ".rtbw") {
+                names.push_back(file.substr(0, file.size() - 5));
+            }
+        }
+        closedir(dir);
+
+        for (const string& name : names) {
+            add_table(directory + "/" + name, name, false);
+            string dtz_path = directory + "/" + name + ".rtbz";
+            if (access(dtz_path.c_str(), R_OK) == 0) {
+                add_table(directory + "/" + name, name, true);
+            }
+        }
+        probe_limit = max_pieces;
+        return count_if(tables.begin(), tables.end(), [](const unique_ptr<table_t>& table) { return !table->dtz; });
+    }
+
+    // Whether there is a table for the material. Tables know nothing of castling
+    bool can_probe(const bitboard_t& board) const {
+        U64 occupied = board.get_all_friendly_pieces(Color::WHITE) | board.get_all_friendly_pieces(Color::BLACK);
+        return __builtin_popcountll(occupied) <= probe_limit && wdl_tables.count(board.material_key) &&
+               !board.white_king_side_castle && !board.white_queen_side_castle && !board.black_king_side_castle &&
+               !board.black_queen_side_castle;
+    }
+
+    // Result for the side to move. Captures are searched first, the tables assume there is no en passant and are
+    // not stored for positions where a capture is the best move
+    wdl_t probe_wdl(bitboard_t& board, probe_state_t& state) {
+        state = OK;
+        return search(board, state, false);
+    }
+
+    // Plies until the next capture or pawn move for the side to move, positive when winning, negative when losing,
+    // 0 for a draw. With cursed wins and blessed losses the distance is 100 too high
+    int probe_dtz(bitboard_t& board, probe_state_t& state) {
+        state      = OK;
+        wdl_t wdl  = search(board, state, true);
+        if (state == FAIL || wdl == DRAW) {
+            return 0;
+        }
+        if (state == ZEROING_BEST_MOVE) {
+            return dtz_before_zeroing(wdl);
+        }
+        int dtz = probe(board, true, wdl, state);
+        if (state == FAIL) {
+            return 0;
+        }
+        if (state != CHANGE_STM) {
+            return (dtz + 100 * (wdl == BLESSED_LOSS || wdl == CURSED_WIN)) * sign(wdl);
+        }
+
+        // The table has the other side to move, so look one ply ahead for the best distance
+        Color color     = board.active_color;
+        int min_dtz     = 0xFFFF;
+        move_list_t all = moves::generate_all_moves_for_color(board, color);
+        for (int i = 0; i < all.count; i++) {
+            const bitboard_move_t& move = all.moves[i];
+            bool zeroing = is_capture(board, move, color) || (move.from_board & (board.board_w_P | board.board_b_P));
+            piece_t captured = moves::make_move(board, move);
+            dtz = zeroing ? -dtz_before_zeroing(search(board, state, false)) : -probe_dtz(board, state);
+            if (dtz == 1 && is_mate(board)) {
+                min_dtz = 1;
+            }
+            if (!zeroing) {
+                dtz += sign(dtz);
+            }
+            if (dtz < min_dtz && sign(dtz) == sign(wdl)) {
+                min_dtz = dtz;
+            }
+            moves::undo_move(board, move, captured);
+            if (state == FAIL) {
+                return 0;
+            }
+        }
+        return min_dtz == 0xFFFF ? -1 : min_dtz;
+    }
+
+    // Picks a root move by DTZ: the shortest way to the next capture or pawn move that keeps the win, so the win is
+    // converted within the fifty move rule, or the longest resistance when losing. Returns false if the position is
+    // not in the tables.
+    bool probe_root(bitboard_t& board, bitboard_move_t& best_move, wdl_t& wdl) {
+        probe_state_t state;
+        if (!can_probe(board)) {
+            return false;
+        }
+        wdl = probe_wdl(board, state);
+        if (state == FAIL) {
+            return false;
+        }
+
+        Color color     = board.active_color;
+        int best_rank   = NEG_RANK;
+        move_list_t all = moves::generate_all_moves_for_color(board, color);
+        for (int i = 0; i < all.count; i++) {
+            const bitboard_move_t& move = all.moves[i];
+            bool zeroing = is_capture(board, move, color) || (move.from_board & (board.board_w_P | board.board_b_P));
+            piece_t captured = moves::make_move(board, move);
+            int dtz;
+            if (zeroing) {
+                dtz = dtz_before_zeroing(wdl_t(-probe_wdl(board, state)));
+            } else {
+                dtz = -probe_dtz(board, state);
+                dtz += sign(dtz);
+            }
+            if (dtz == 2 && is_mate(board)) {
+                dtz = 1;
+            }
+            moves::undo_move(board, move, captured);
+            if (state == FAIL) {
+                return false;
+            }
+
+            int rank = dtz > 0 ? 1000 - dtz : dtz < 0 ? -1000 - dtz : 0;
+            if (rank > best_rank) {
+                best_rank = rank;
+                best_move = move;
+            }
+        }
+        return best_rank != NEG_RANK;
+    }
+
+  private:
+    static constexpr int NEG_RANK = -1000000;
+
+    vector<unique_ptr<table_t>> tables;
+    unordered_map<U64, table_t*> wdl_tables; // by both material keys
+    unordered_map<U64, table_t*> dtz_tables;
+
+    void add_table(const string& path_without_extension, const string& name, bool dtz) {
+        int counts[2][6] = {};
+        if (!parse_name(name, counts)) {
+            return;
+        }
+        auto table         = make_unique<table_t>();
+        table->dtz         = dtz;
+        table->path        = path_without_extension + (dtz ? ".rtbz" : ".rtbw");
+        table->key         = material_key(counts, 0);
+        table->key2        = material_key(counts, 1);
+        table->piece_count = 2;
+        for (int side = 0; side < 2; side++) {
+            for (PieceType type : NAME_TYPES) {
+                int count = counts[side][int(type)];
+                table->piece_count += count;
+                table->has_unique_pieces |= count == 1;
+            }
+        }
+        if (table->piece_count > MAX_PIECES) {
+            return;
+        }
+        int white_pawns  = counts[0][int(PieceType::PAWN)];
+        int black_pawns  = counts[1][int(PieceType::PAWN)];
+        table->has_pawns = white_pawns + black_pawns > 0;
+        // The side with fewer pawns leads, it compresses better
+        bool white_leads      = black_pawns == 0 || (white_pawns > 0 && black_pawns >= white_pawns);
+        table->pawn_count[0]  = uint8_t(white_leads ? white_pawns : black_pawns);
+        table->pawn_count[1]  = uint8_t(white_leads ? black_pawns : white_pawns);
+
+        auto& index = dtz ? dtz_tables : wdl_tables;
+        index[table->key]  = table.get();
+        index[table->key2] = table.get();
+        max_pieces         = max(max_pieces, table->piece_count);
+        tables.push_back(move(table));
+    }
+
+    static bool is_mate(bitboard_t& board) {
+        return moves::is_in_check(board, board.active_color) &&
+               moves::generate_all_moves_for_color(board, board.active_color).count == 0;
+    }
+
+    int probe(const bitboard_t& board, bool dtz, wdl_t wdl, probe_state_t& state) {
+        if (__builtin_popcountll(board.get_all_friendly_pieces(Color::WHITE) |
+                                 board.get_all_friendly_pieces(Color::BLACK)) == 2) {
+            return DRAW; // two bare kings
+        }
+        auto& index = dtz ? dtz_tables : wdl_tables;
+        auto found  = index.find(board.material_key);
+        if (found == index.end() || !map_table(*found->second)) {
+            state = FAIL;
+            return 0;
+        }
+        return probe_table(board, *found->second, wdl, state);
+    }
+
+    // Resolves captures (and with zeroing, pawn moves too) before looking at the table
+    wdl_t search(bitboard_t& board, probe_state_t& state, bool zeroing) {
+        wdl_t best      = LOSS;
+        Color color     = board.active_color;
+        move_list_t all = moves::generate_all_moves_for_color(board, color);
+        int move_count  = 0;
+        for (int i = 0; i < all.count; i++) {
+            const bitboard_move_t& move = all.moves[i];
+            if (!is_capture(board, move, color) &&
+                (!zeroing || !(move.from_board & (board.board_w_P | board.board_b_P)))) {
+                continue;
+            }
+            move_count++;
+            piece_t captured = moves::make_move(board, move);
+            wdl_t value      = wdl_t(-search(board, state, false));
+            moves::undo_move(board, move, captured);
+            if (state == FAIL) {
+                return DRAW;
+            }
+            if (value > best) {
+                best = value;
+                if (value >= WIN) {
+                    state = ZEROING_BEST_MOVE;
+                    return value;
+                }
+            }
+        }
+
+        // When every legal move was searched the table is not needed, and may even be wrong (en passant)
+        bool no_more_moves = move_count > 0 && move_count == all.count;
+        wdl_t value        = best;
+        if (!no_more_moves) {
+            value = wdl_t(probe(board, false, DRAW, state));
+            if (state == FAIL) {
+                return DRAW;
+            }
+        }
+        if (best >= value) {
+            state = (best > DRAW || no_more_moves) ? ZEROING_BEST_MOVE : OK;
+            return best;
+        }
+        state = OK;
+        return value;
+    }
+};
+
+} // namespace syzygy
+
+#endif
@@ -97,7 +97,8 @@ bool compare_bitboard_states(const bitboard_state& a, const bitboard_state& b) {
            a.white_queen_side_castle == b.white_queen_side_castle &&
            a.black_king_side_castle == b.black_king_side_castle &&
            a.black_queen_side_castle == b.black_queen_side_castle &&
-           a.en_passant_square == b.en_passant_square;
+           a.en_passant_square == b.en_passant_square &&
+           a.pawn_key == b.pawn_key && a.material_key == b.material_key;
 }
 
 bool compare_boards(const bitboard_t& a, const bitboard_t& b) {
@@ -457,7 +458,9 @@ void test_board_state_history() {
                           board.white_queen_side_castle,
                           board.black_king_side_castle,
                           board.black_queen_side_castle,
-                          board.en_passant_square});
+                          board.en_passant_square,
+                          board.pawn_key,
+                          board.material_key});
         captured_pieces.push_back(moves::make_move(board, moves.moves[i]));
     }
 
@@ -469,9 +472,70 @@ void test_board_state_history() {
         assert(board.black_king_side_castle == states[i].black_king_side_castle);
         assert(board.black_queen_side_castle == states[i].black_queen_side_castle);
         assert(board.en_passant_square == states[i].en_passant_square);
+        assert(board.pawn_key == states[i].pawn_key);
+        assert(board.material_key == states[i].material_key);
     }
 }
 
+void test_incremental_keys() {
+    // En passant, a promotion, castling and captures of and by pawns
+    bitboard_t board;
+    board.initialize_board_from_fen("r3k2r/1P6/8/3pP3/8/1p6/P7/R3K2R w KQkq d6 0 1");
+    U64 initial_key          = board.pawn_key;
+    U64 initial_material_key = board.material_key;
+    assert(initial_key == board.compute_pawn_key());
+    assert(initial_material_key == board.compute_material_key());
+
+    vector<string> move_strings = {"e5d6", "e8g8", "b7b8q", "b3a2", "b8a8", "a2a1q", "d6d7", "f8a8"};
+    vector<bitboard_move_t> moves;
+    vector<piece_t> captured_pieces;
+    for (const string& move_str : move_strings) {
+        moves.push_back(coordinate_move_to_bitboard_move(parse_move_from_string(move_str)));
+        captured_pieces.push_back(moves::make_move(board, moves.back()));
+        assert(board.pawn_key == board.compute_pawn_key());
+        assert(board.material_key == board.compute_material_key());
+    }
+
+    for (int i = int(moves.size()) - 1; i >= 0; i--) {
+        moves::undo_move(board, moves[i], captured_pieces[i]);
+        assert(board.pawn_key == board.compute_pawn_key());
+        assert(board.material_key == board.compute_material_key());
+    }
+    assert(board.pawn_key == initial_key);
+    assert(board.material_key == initial_material_key);
+}
+
+void test_null_move() {
+    bitboard_t board;
+    board.initialize_board_from_fen("4k3/8/8/3pP3/8/8/8/4K3 w - d6 0 1");
+    bitboard_t initial_board = board;
+
+    moves::make_null_move(board);
+    assert(compare_boards(board, initial_board)); // no piece moved
+    assert(board.en_passant_square == 0ULL);      // en passant right is gone
+    assert(board.active_color == Color::BLACK);
+    assert(board.move_history.size() == initial_board.move_history.size());
+
+    moves::undo_null_move(board);
+    assert(board.en_passant_square == initial_board.en_passant_square);
+    assert(board.active_color == Color::WHITE);
+    assert(board.state_history.size() == initial_board.state_history.size());
+    assert(board.position_hash_history.size() == initial_board.position_hash_history.size());
+
+    // The position comes up a third time, but only because of a null move on the way. That is no repetition
+    board.initialize_board_from_fen("4k3/8/8/8/8/8/8/R3K3 w - - 0 1");
+    auto play = [&](const vector<string>& moves) {
+        for (const string& move_str : moves) {
+            moves::make_move(board, coordinate_move_to_bitboard_move(parse_move_from_string(move_str)));
+        }
+    };
+    play({"a1a2", "e8d8", "a2a1", "d8e8", "a1a2", "e8d8", "a2a1", "d8e8"});
+    assert(hash_t::is_threefold_repetition(board));
+    moves::make_null_move(board);
+    play({"e8d8", "e1f1", "d8e8", "f1f2", "e8d8", "f2e1", "d8e8"}); // the white king walks a triangle
+    assert(!hash_t::is_threefold_repetition(board));
+}
+
 void test_check_and_checkmate() {
     // Test 1: Direct checks from different pieces
     vector<pair<string, bool>> check_positions = {
@@ -554,11 +618,15 @@ void test_alpha_beta_pruning() {
     bitboard_t board;
     board.initialize_board_from_fen("r1bqk2r/ppp2ppp/2n2n2/1B1pp3/1b2P3/2NP1N2/PPP2PPP/R1BQK2R w KQkq - 0 7");
 
-    // Get results with pruning
-    auto result_with_pruning = engine::negamax(board, 4, engine::NEG_INFINITY, engine::POS_INFINITY, Color::WHITE);
+    // Get results with pruning. Both searches end in a quiescence search at every leaf, which makes the unpruned one
+    // slow, so this runs a ply shallower than it used to and without a time limit
+    engine::SearchContext context;
+    context.time_manager.init_fixed(LONG_MAX);
+    engine::Searcher searcher(context);
+    auto result_with_pruning = searcher.negamax(board, 3, engine::NEG_INFINITY, engine::POS_INFINITY, Color::WHITE);
 
     // Get results without pruning
-    auto result_without_pruning = engine::negamax_without_pruning(board, 4, Color::WHITE);
+    auto result_without_pruning = engine::negamax_without_pruning(searcher, board, 3, Color::WHITE);
 
     // Verify results
     assert(result_with_pruning.nodes < result_without_pruning.nodes);
@@ -575,7 +643,9 @@ void test_alpha_beta_pruning() {
 void test_white_maximizes() {
     bitboard_t board;
     board.initialize_board_from_fen("p7/8/8/8/8/3p4/4P3/8");
-    auto [best_move, search_result] = engine::get_best_move(board, 7, Color::WHITE);
+    engine::SearchContext context;
+    engine::Searcher searcher(context);
+    auto [best_move, search_result] = searcher.get_best_move(board, 7, Color::WHITE);
     string string_move              = encode_move(bitboard_move_to_coordinate_move(best_move));
     assert(string_move == "e2d3");
     assert(search_result.score > 0);
@@ -584,12 +654,39 @@ void test_white_maximizes() {
 void test_black_minimizes() {
     bitboard_t board;
     board.initialize_board_from_fen("8/3p4/4P3/8/8/8/8/7P");
-    auto [best_move, search_result] = engine::get_best_move(board, 7, Color::BLACK);
+    engine::SearchContext context;
+    engine::Searcher searcher(context);
+    auto [best_move, search_result] = searcher.get_best_move(board, 7, Color::BLACK);
     string string_move              = encode_move(bitboard_move_to_coordinate_move(best_move));
     assert(string_move == "d7e6");
     assert(search_result.score < 0);
 }
 
+void test_static_exchange_evaluation() {
+    bitboard_t board;
+
+    // Undefended pawn
+    board.initialize_board_from_fen("1k1r4/1pp4p/p7/4p3/8/P5P1/1PP4P/2K1R3 w - - 0 1");
+    assert(engine::see(board, bitboard_move_t(1ULL << 4, 1ULL << 36)) == eval::PAWN_VALUE);
+
+    // Knight for a pawn, however long the exchange goes on
+    board.initialize_board_from_fen("1k1r3q/1ppn3p/p4b2/4p3/8/P2N2P1/1PP1R1BP/2K1Q3 w - - 0 1");
+    bitboard_move_t knight_takes(1ULL << 19, 1ULL << 36);
+    assert(engine::see(board, knight_takes) == eval::PAWN_VALUE - eval::KNIGHT_VALUE);
+    assert(engine::see_ge(board, knight_takes, -eval::KNIGHT_VALUE));
+    assert(!engine::see_ge(board, knight_takes, 0));
+
+    // The rook on d8 only defends through the one on d7
+    board.initialize_board_from_fen("3r2k1/3r4/8/3p4/8/8/3R4/3R2K1 w - - 0 1");
+    assert(engine::see(board, bitboard_move_t(1ULL << 11, 1ULL << 35)) == eval::PAWN_VALUE - eval::ROOK_VALUE);
+
+    // Same exchange without the x-ray, white wins the pawn
+    board.initialize_board_from_fen("6k1/3r4/8/3p4/8/8/3R4/3R2K1 w - - 0 1");
+    assert(engine::see(board, bitboard_move_t(1ULL << 11, 1ULL << 35)) == eval::PAWN_VALUE);
+
+    cout << "✓ Static exchange evaluation test passed\n" << endl;
+}
+
 void test_threefold_repetition() {
     // Test more or less copied from https://www.chess.com/terms/threefold-repetition-chess
     bitboard_t board;
@@ -623,6 +720,482 @@ void test_threefold_repetition() {
     // Test that should eval to false:
 }
 
+void test_upcoming_repetition() {
+    bitboard_t board;
+    board.initialize_board_from_fen("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1");
+
+    auto play = [&](const vector<string>& moves) {
+        for (const string& move_str : moves) {
+            moves::make_move(board, coordinate_move_to_bitboard_move(parse_move_from_string(move_str)));
+        }
+    };
+
+    // Black can return to the starting position with f6g8, but that would only be its second occurrence...
+    play({"g1f3", "g8f6", "f3g1"});
+    assert(!hash_t::has_upcoming_repetition(board, 0));
+    // ...unless the earlier position was reached during the search
+    assert(hash_t::has_upcoming_repetition(board, 4));
+
+    // The third occurrence is a draw no matter where the earlier ones happened
+    play({"f6g8", "g1f3", "g8f6", "f3g1"});
+    assert(hash_t::has_upcoming_repetition(board, 0));
+
+    // After a pawn move there is nothing left to repeat
+    play({"e7e5"});
+    assert(!hash_t::has_upcoming_repetition(board, 0));
+    assert(!hash_t::has_upcoming_repetition(board, 10));
+
+    cout << "✓ Upcoming repetition test passed\n" << endl;
+}
+
+void test_qsearch_in_check() {
+    engine::SearchContext context;
+    context.time_manager.init_fixed(LONG_MAX);
+    engine::Searcher searcher(context);
+    bitboard_t board;
+
+    // Mated at the horizon: no standing pat on the material
+    board.initialize_board_from_fen("7k/6Q1/5K2/8/8/8/8/8 b - - 0 1");
+    int score = searcher.qsearch(board, engine::NEG_INFINITY, engine::POS_INFINITY, Color::BLACK, 3).score;
+    assert(score == engine::MATE_SCORE - 3);
+
+    // In check with a way out: an ordinary score, not a mate
+    board.initialize_board_from_fen("7k/8/8/8/8/8/8/K5q1 w - - 0 1");
+    score = searcher.qsearch(board, engine::NEG_INFINITY, engine::POS_INFINITY, Color::WHITE, 0).score;
+    assert(!engine::is_mate_score(score) && score < -eval::QUEEN_VALUE / 2);
+
+    cout << "✓ Quiescence search in check test passed\n" << endl;
+}
+
+void test_mate_scores_in_tt() {
+    // A mate 5 plies from the root, found at ply 2, is a mate in 3 from that position. Reached again at ply 4 it is
+    // 7 plies from the root
+    using engine::MATE_SCORE;
+    int stored = engine::score_to_tt(MATE_SCORE - 5, 2);
+    assert(stored == MATE_SCORE - 3);
+    assert(engine::score_from_tt(stored, 4) == MATE_SCORE - 7);
+    assert(engine::score_from_tt(engine::score_to_tt(-(MATE_SCORE - 6), 3), 1) == -(MATE_SCORE - 4));
+    assert(engine::score_to_tt(250, 9) == 250 && engine::score_from_tt(-250, 9) == -250);
+    assert(engine::score_from_tt(engine::score_to_tt(engine::TB_WIN_SCORE - 6, 2), 5) == engine::TB_WIN_SCORE - 9);
+
+    // The table is shared between iterations, the mate in one has to keep its distance in every one of them
+    bitboard_t board;
+    board.initialize_board_from_fen("7k/8/5K2/8/8/8/8/6Q1 w - - 0 1");
+    engine::SearchContext context;
+    context.time_manager.init_fixed(LONG_MAX);
+    engine::Searcher searcher(context);
+    for (int depth = 1; depth <= 5; depth++) {
+        assert(searcher.get_best_move(board, depth, Color::WHITE).second.score == MATE_SCORE - 1);
+    }
+
+    cout << "✓ Mate scores in the transposition table test passed\n" << endl;
+}
+
+void test_razoring_and_probcut() {
+    // WAC.001: Qg6 mates in two, though it gives up the queen. Razoring fires on the way and must not hide the mate
+    bitboard_t board;
+    board.initialize_board_from_fen("2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1");
+    engine::tt.clear();
+    engine::SearchContext context;
+    context.time_manager.init_fixed(LONG_MAX);
+    engine::Searcher searcher(context);
+    pair<bitboard_move_t, engine::SearchResult> best;
+    for (int depth = 1; depth <= 7; depth++) {
+        best = searcher.get_best_move(board, depth, Color::WHITE);
+    }
+    assert(encode_move(bitboard_move_to_coordinate_move(best.first)) == "g3g6");
+    assert(best.second.score == engine::MATE_SCORE - 3);
+    assert(searcher.stats.razored > 0);
+
+    // A quiet middlegame, where both prune something
+    board.initialize_board_from_fen("r2q1rk1/1b2bppp/p2p1n2/1pn1p3/4P3/1BN2N1P/PPP1QPP1/R1B2RK1 w - - 0 1");
+    engine::tt.clear();
+    engine::SearchContext quiet_context;
+    quiet_context.time_manager.init_fixed(LONG_MAX);
+    engine::Searcher quiet_searcher(quiet_context);
+    for (int depth = 1; depth <= 6; depth++) {
+        quiet_searcher.get_best_move(board, depth, Color::WHITE);
+    }
+    assert(quiet_searcher.stats.razored > 0 && quiet_searcher.stats.probcut_cutoffs > 0);
+
+    cout << "✓ Razoring and ProbCut test passed\n" << endl;
+}
+
+void test_late_move_pruning() {
+    // More moves are searched the more depth is left, and more again while the position is improving
+    for (int depth = 1; depth <= engine::LMP_MAX_DEPTH; depth++) {
+        assert(engine::lmp_table.move_counts[0][depth] > engine::lmp_table.move_counts[0][depth - 1]);
+        assert(engine::lmp_table.move_counts[1][depth] > engine::lmp_table.move_counts[1][depth - 1]);
+    }
+    for (int depth = 0; depth <= engine::LMP_MAX_DEPTH; depth++) {
+        assert(engine::lmp_table.move_counts[1][depth] >= engine::lmp_table.move_counts[0][depth]);
+    }
+
+    // Turned off the way --param does it, the search gets bigger but still finds the same move
+    bitboard_t board;
+    board.initialize_board_from_fen("8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1");
+    bitboard_move_t best_moves[2];
+    long long nodes[2], pruned[2];
+    for (int late_move_pruning : {0, 1}) {
+        engine::tt.clear();
+        engine::SearchContext context;
+        context.time_manager.init_fixed(LONG_MAX);
+        assert(context.params.set("late_move_pruning", late_move_pruning));
+        engine::Searcher searcher(context);
+        for (int depth = 1; depth <= 7; depth++) {
+            best_moves[late_move_pruning] = searcher.get_best_move(board, depth, Color::WHITE).first;
+        }
+        nodes[late_move_pruning]  = searcher.stats.nodes;
+        pruned[late_move_pruning] = searcher.stats.late_move_pruned + searcher.stats.history_pruned;
+    }
+    assert(engine::same_move(best_moves[0], best_moves[1]));
+    assert(pruned[0] == 0 && pruned[1] > 0 && nodes[1] < nodes[0]);
+
+    cout << "✓ Late move pruning test passed\n" << endl;
+}
+
+void test_counter_move_and_continuation_history() {
+    using engine::SearcherInspector;
+    auto move_of = [](const string& move_str) {
+        return coordinate_move_to_bitboard_move(parse_move_from_string(move_str));
+    };
+    bitboard_t board;
+    board.initialize_board_from_fen("rnbqkbnr/pppp1ppp/8/4p3/4P3/8/PPPP1PPP/RNBQKBNR w KQkq e6 0 2");
+    engine::SearchContext context;
+    engine::Searcher searcher(context);
+
+    // 1. e4 e5 led here, and Nf3 refuted e5 two plies further down
+    bitboard_move_t knight_move = move_of("g1f3");
+    SearcherInspector::set_stack_move(searcher, 0, move_of("e2e4"), PieceType::PAWN);
+    SearcherInspector::set_stack_move(searcher, 1, move_of("e7e5"), PieceType::PAWN);
+    int history_before = SearcherInspector::quiet_history(searcher, knight_move, PieceType::KNIGHT, Color::WHITE, 2);
+    SearcherInspector::update_cutoff_move(searcher, board, knight_move, Color::WHITE, 2, 6);
+    assert(engine::same_move(SearcherInspector::counter_move(searcher, Color::WHITE, PieceType::PAWN, 36), knight_move));
+    int history_after = SearcherInspector::quiet_history(searcher, knight_move, PieceType::KNIGHT, Color::WHITE, 2);
+    assert(history_after > history_before);
+
+    // After another pair of moves the butterfly history is the same, only the continuation part differs
+    SearcherInspector::set_stack_move(searcher, 2, move_of("d2d4"), PieceType::PAWN);
+    SearcherInspector::set_stack_move(searcher, 3, move_of("d7d5"), PieceType::PAWN);
+    int other_line = SearcherInspector::quiet_history(searcher, knight_move, PieceType::KNIGHT, Color::WHITE, 4);
+    assert(other_line > 0 && other_line < history_after);
+
+    // Reached again after e4 e5 at a ply without killers, the knight move is tried first
+    SearcherInspector::set_stack_move(searcher, 2, move_of("e2e4"), PieceType::PAWN);
+    SearcherInspector::set_stack_move(searcher, 3, move_of("e7e5"), PieceType::PAWN);
+    move_list_t move_list = moves::generate_all_moves_for_color(board, Color::WHITE);
+    SearcherInspector::order_moves(searcher, board, move_list, Color::WHITE, 4);
+    assert(engine::same_move(move_list.moves[0], knight_move));
+
+    cout << "✓ Counter move and continuation history test passed\n" << endl;
+}
+
+void test_root_move_order() {
+    // White wins the queen with the rook, everything else fails low
+    bitboard_t board;
+    board.initialize_board_from_fen("3qk3/8/8/8/8/8/8/3RK3 w - - 0 1");
+    engine::tt.clear();
+    engine::SearchContext context;
+    context.time_manager.init_fixed(LONG_MAX);
+    engine::Searcher searcher(context);
+
+    vector<engine::RootMove> previous;
+    for (int depth = 1; depth <= 4; depth++) {
+        auto [best_move, result]             = searcher.get_best_move(board, depth, Color::WHITE);
+        const vector<engine::RootMove>& root = searcher.ordered_root_moves();
+
+        // The best move first with its exact score, the others keep the bound they failed low against. Ties are
+        // broken by the score of the previous iteration
+        assert(engine::same_move(root[0].move, best_move) && root[0].score == result.score);
+        assert(encode_move(bitboard_move_to_coordinate_move(best_move)) == "d1d8");
+        for (size_t i = 1; i < root.size(); i++) {
+            assert(root[i].score > engine::NEG_INFINITY && root[i].score <= result.score);
+            if (i > 1) {
+                assert(root[i].score < root[i - 1].score ||
+                       (root[i].score == root[i - 1].score && root[i].previous_score <= root[i - 1].previous_score));
+            }
+        }
+
+        // Every move remembers what it scored one iteration back
+        for (const engine::RootMove& root_move : root) {
+            for (const engine::RootMove& before : previous) {
+                if (engine::same_move(before.move, root_move.move)) {
+                    assert(root_move.previous_score == before.score);
+                }
+            }
+        }
+        previous = root;
+    }
+
+    cout << "✓ Root move order test passed\n" << endl;
+}
+
+// Results of searches that were cut short score beyond any mate. None of them may have reached the table
+bool tt_holds_only_finished_results(const transposition_table_t& table) {
+    bool finished = true;
+    TranspositionTableInspector::for_each_entry(table, [&finished](const tt_entry_t& entry) {
+        finished = finished && abs(entry.score) <= engine::MATE_SCORE;
+    });
+    return finished;
+}
+
+void test_tt_torn_entries() {
+    transposition_table_t table(1);
+    U64 key           = 0x9E3779B97F4A7C15ULL;
+    tt_entry_t first  = {120, 5, Bound::EXACT, bitboard_move_t(1ULL << 12, 1ULL << 28, PieceType::EMPTY)};
+    tt_entry_t second = {-40, 9, Bound::LOWER, bitboard_move_t(1ULL << 6, 1ULL << 21, PieceType::EMPTY)};
+    tt_entry_t entry;
+
+    table.store(key, first);
+    assert(table.probe(key, entry) && entry.score == 120 && entry.depth == 5 && entry.bound == Bound::EXACT);
+
+    // The check word of one write with the data of another is a miss, and the next whole write replaces it
+    TranspositionTableInspector::tear(table, key, first, second);
+    assert(!table.probe(key, entry));
+    table.store(key, second);
+    assert(table.probe(key, entry) && entry.score == -40 && entry.depth == 9);
+
+    // Writers racing for the same slot: whatever a reader finds belongs to the key it asked for
+    vector<thread> writers;
+    atomic<int> mismatches{0};
+    for (int t = 0; t < 4; t++) {
+        writers.emplace_back([&table, &mismatches, t] {
+            tt_entry_t found;
+            for (int i = 0; i < 100000; i++) {
+                int writer = (i + t) % 4;
+                U64 own    = (U64(t + 1) << 40) | 5; // every key maps to slot 5
+                U64 other  = (U64(writer + 1) << 40) | 5;
+                table.store(own, {1000 * (t + 1), i % 64, Bound::EXACT, {}});
+                if (table.probe(other, found) && found.score != 1000 * (writer + 1)) {
+                    mismatches++;
+                }
+            }
+        });
+    }
+    for (thread& writer : writers) {
+        writer.join();
+    }
+    assert(mismatches == 0);
+
+    cout << "✓ Transposition table torn entry test passed\n" << endl;
+}
+
+void test_lazy_smp() {
+    // WAC.001, Qg6 mates in two. The helpers only talk to the main thread through the table, which must not lead it to
+    // another move than it finds alone
+    bitboard_t board;
+    board.initialize_board_from_fen("2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1");
+    constexpr int depth = 7;
+
+    engine::tt.clear();
+    engine::SearchContext serial_context;
+    serial_context.time_manager.init_fixed(LONG_MAX);
+    engine::Searcher serial_searcher(serial_context);
+    pair<bitboard_move_t, engine::SearchResult> serial;
+    for (int d = 1; d <= depth; d++) {
+        serial = serial_searcher.get_best_move(board, d, Color::WHITE);
+    }
+
+    engine::tt.clear();
+    engine::SearchContext context;
+    context.time_manager.init_fixed(LONG_MAX);
+    context.start_helper_threads(board, Color::WHITE, 3);
+    engine::Searcher searcher(context);
+    pair<bitboard_move_t, engine::SearchResult> parallel;
+    for (int d = 1; d <= depth; d++) {
+        parallel = searcher.get_best_move(board, d, Color::WHITE);
+    }
+    context.stop_helper_threads();
+
+    assert(engine::same_move(parallel.first, serial.first) && parallel.second.score == serial.second.score);
+    for (const auto& helper : context.helpers) {
+        assert(helper->stats.nodes > 0);
+    }
+    assert(tt_holds_only_finished_results(engine::tt));
+
+    cout << "✓ Lazy SMP test passed\n" << endl;
+}
+
+void test_ybwc() {
+    // Qg6 mates in two in WAC.001, Kiwipete is full of captures and checks. Split points below the root are searched by
+    // several threads at once, cut off by any of them, and still have to come to the serial result
+    const string fens[] = {"2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1",
+                           "r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1"};
+    constexpr int depth = 6;
+
+    for (const string& fen : fens) {
+        bitboard_t board;
+        board.initialize_board_from_fen(fen);
+
+        engine::tt.clear();
+        engine::SearchContext serial_context;
+        serial_context.time_manager.init_fixed(LONG_MAX);
+        engine::Searcher serial_searcher(serial_context);
+        pair<bitboard_move_t, engine::SearchResult> serial;
+        for (int d = 1; d <= depth; d++) {
+            serial = serial_searcher.get_best_move(board, d, board.active_color);
+        }
+
+        for (int workers = 1; workers <= 3; workers++) {
+            engine::tt.clear();
+            engine::SearchContext context;
+            context.time_manager.init_fixed(LONG_MAX);
+            context.parallel_mode = engine::ParallelMode::YBWC;
+            context.start_helper_threads(board, board.active_color, workers);
+            engine::Searcher searcher(context);
+            pair<bitboard_move_t, engine::SearchResult> parallel;
+            for (int d = 1; d <= depth; d++) {
+                parallel = searcher.get_best_move(board, d, board.active_color);
+            }
+            context.stop_helper_threads();
+
+            assert(engine::same_move(parallel.first, serial.first));
+            long long split_points = searcher.stats.split_points, split_cutoffs = searcher.stats.split_cutoffs;
+            for (const auto& helper : context.helpers) {
+                assert(helper->stats.nodes > 0);
+                split_points += helper->stats.split_points;
+                split_cutoffs += helper->stats.split_cutoffs;
+            }
+            assert(split_points > 0 && split_cutoffs > 0);
+
+            // The tasks still running when a brother failed high were abandoned, none of them may have been stored
+            assert(tt_holds_only_finished_results(engine::tt));
+        }
+    }
+
+    cout << "✓ YBWC test passed\n" << endl;
+}
+
+void test_stop_flag() {
+    // Neither limit is ever reached on its own: the hard limit stops the first searches, the flag raised from another
+    // thread the others. Every thread polls it, so the whole search unwinds within a few nodes
+    bitboard_t board;
+    board.initialize_board_from_fen("r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1");
+    static constexpr long STOP_MS = 100;
+    constexpr long GRACE_MS       = 400; // the threads share whatever cores there are
+
+    for (bool raise_flag : {false, true}) {
+        for (engine::ParallelMode mode : {engine::ParallelMode::LAZY_SMP, engine::ParallelMode::YBWC}) {
+            for (int helpers : {0, 3}) {
+                engine::tt.clear();
+                engine::SearchContext context;
+                context.time_manager.init_fixed(raise_flag ? LONG_MAX : STOP_MS);
+                context.parallel_mode = mode;
+                context.start_helper_threads(board, Color::WHITE, helpers);
+                thread stopper;
+                if (raise_flag) {
+                    stopper = thread([&context] {
+                        this_thread::sleep_for(chrono::milliseconds(STOP_MS));
+                        context.stop = true;
+                    });
+                }
+
+                engine::Searcher searcher(context);
+                engine::RootResult result = searcher.search(board, Color::WHITE);
+                long returned_ms          = context.elapsed_ms();
+                context.stop_helper_threads();
+                if (stopper.joinable()) {
+                    stopper.join();
+                }
+
+                assert(returned_ms < STOP_MS + GRACE_MS && context.elapsed_ms() < STOP_MS + GRACE_MS);
+                assert(result.completed_depth >= 1 && result.completed_depth < engine::MAX_PLY - 1);
+                assert(tt_holds_only_finished_results(engine::tt));
+            }
+        }
+    }
+
+    cout << "✓ Stop flag test passed\n" << endl;
+}
+
+void test_aborted_iteration() {
+    // Unless an iteration ends just before the time is up, the hard limit hits in the middle of the next one. Its moves
+    // were searched against the previous best one, which is still first in the root move list, so the returned move is
+    // either that one or proven better than it
+    int aborted = 0;
+    const string fens[] = {"r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 1",
+                           "r2q1rk1/1b2bppp/p2p1n2/1pn1p3/4P3/1BN2N1P/PPP1QPP1/R1B2RK1 w - - 0 1",
+                           "8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 1"};
+    for (const string& fen : fens) {
+        for (long limit_ms : {10, 30, 70, 150}) {
+            bitboard_t board;
+            board.initialize_board_from_fen(fen);
+            Color color = board.active_color;
+            engine::tt.clear();
+            engine::SearchContext context;
+            context.time_manager.init_fixed(limit_ms);
+            engine::Searcher searcher(context);
+            engine::RootResult result = searcher.search(board, color);
+            aborted += context.stop.load();
+            assert(result.completed_depth >= 1);
+
+            move_list_t legal_moves = moves::generate_all_moves_for_color(board, color);
+            bool is_legal           = false;
+            for (int i = 0; i < legal_moves.count; i++) {
+                is_legal = is_legal || engine::same_move(legal_moves.moves[i], result.best_move);
+            }
+            assert(is_legal);
+
+            const vector<engine::RootMove>& root = searcher.ordered_root_moves();
+            if (!engine::same_move(result.best_move, root[0].move)) {
+                auto better = find_if(root.begin(), root.end(), [&result](const engine::RootMove& root_move) {
+                    return engine::same_move(root_move.move, result.best_move);
+                });
+                assert(better != root.end());
+                assert(color == Color::WHITE ? better->score > root[0].score : better->score < root[0].score);
+            }
+        }
+    }
+    assert(aborted > 0);
+
+    cout << "✓ Aborted iteration test passed\n" << endl;
+}
+
+void test_time_manager() {
+    using namespace timeman;
+    time_manager_t time_manager;
+
+    // A minute without increment at the start: a 50th of what is left after the overhead, the hard limit 5 times that
+    time_manager.init(60000, 0, 0);
+    assert(time_manager.optimum_ms == 59900 / 50 && time_manager.maximum_ms == 5 * (59900 / 50));
+
+    // The increment adds to the optimum, and later in the game fewer moves are left to plan for
+    time_manager.init(60000, 1000, 0);
+    assert(time_manager.optimum_ms == long(59900 / 50 + 1000 * INCREMENT_SHARE));
+    time_manager.init(60000, 0, 200);
+    assert(time_manager.optimum_ms == 59900 / MOVES_TO_GO_MIN);
+
+    // A big increment on a low clock is capped by the share of the clock we may spend
+    time_manager.init(1000, 5000, 0);
+    assert(time_manager.maximum_ms == long(900 * MAXIMUM_SHARE) && time_manager.optimum_ms == time_manager.maximum_ms);
+
+    // With less on the clock than the overhead we still search for the minimum time
+    time_manager.init(50, 0, 0);
+    assert(time_manager.optimum_ms == MINIMUM_TIME && time_manager.maximum_ms == MINIMUM_TIME);
+
+    // The soft limit jumps up when the best move changes and then shrinks step by step while it stays the same
+    time_manager.init(60000, 0, 0);
+    assert(time_manager.soft_limit() == time_manager.optimum_ms);
+    time_manager.on_iteration_done(true);
+    assert(time_manager.scale == UNSTABLE_SCALE);
+    double previous_scale = time_manager.scale;
+    for (int iteration = 0; iteration < 20; iteration++) {
+        time_manager.on_iteration_done(false);
+        double expected = max(STABLE_SCALE_MIN, previous_scale - STABLE_SCALE_STEP);
+        assert(abs(time_manager.scale - expected) < 1e-9);
+        previous_scale = time_manager.scale;
+    }
+    assert(time_manager.scale == STABLE_SCALE_MIN);
+    assert(time_manager.soft_limit() == long(time_manager.optimum_ms * STABLE_SCALE_MIN));
+    assert(time_manager.can_start_iteration(0) && !time_manager.can_start_iteration(time_manager.soft_limit()));
+
+    // Without a clock the whole move time is used
+    time_manager.init_fixed(3000);
+    assert(time_manager.soft_limit() == 3000 && time_manager.maximum_ms == 3000);
+
+    cout << "✓ Time manager test passed\n" << endl;
+}
+
 void run_rules_test_suite() {
     cout << "\nRunning move/undo move tests...\n"
          << endl;
@@ -632,11 +1205,27 @@ void run_rules_test_suite() {
     run_move_test("Castling", test_castling);
     run_move_test("Pawn promotion", test_pawn_promotion);
     run_move_test("Board state history", test_board_state_history);
+    run_move_test("Null move", test_null_move);
+    run_move_test("Pawn and material keys", test_incremental_keys);
     run_move_test("Check and checkmate", test_check_and_checkmate);
     test_alpha_beta_pruning();
     test_white_maximizes();
     test_black_minimizes();
+    test_static_exchange_evaluation();
     test_threefold_repetition();
+    test_upcoming_repetition();
+    test_qsearch_in_check();
+    test_mate_scores_in_tt();
+    test_root_move_order();
+    test_razoring_and_probcut();
+    test_late_move_pruning();
+    test_counter_move_and_continuation_history();
+    test_time_manager();
+    test_tt_torn_entries();
+    test_lazy_smp();
+    test_ybwc();
+    test_stop_flag();
+    test_aborted_iteration();
 }
 
 void run_speed_test_suite() {
@@ -697,29 +1286,44 @@ void run_speed_test_negamax() {
 
     auto suite_start     = chrono::high_resolution_clock::now();
 
+    // Every position is searched with late move pruning and then without, from an empty transposition table both times
     for (const auto& [fen, max_depth] : test_positions) {
-        bitboard_t board;
-        board.initialize_board_from_fen(fen);
-        cout << "\nRunning speed test for position:\n";
-        board.pretty_print_board();
-        uint64_t position_nodes = 0;
-        auto position_start     = chrono::high_resolution_clock::now();
-
-        cout << "\n Moves at depth 1 for color: " << moves::generate_all_moves_for_color(board, board.active_color).count + moves::generate_all_moves_for_color(board, !board.active_color).count << "\n";
-
-        for (int depth = 1; depth <= max_depth; depth++) {
-            auto depth_start    = chrono::high_resolution_clock::now();
-            auto best_move = engine::get_best_move(board, depth, board.active_color);
-            auto depth_end      = chrono::high_resolution_clock::now();
-            auto depth_duration = chrono::duration_cast<chrono::milliseconds>(depth_end - depth_start);
+        for (int late_move_pruning : {1, 0}) {
+            bitboard_t board;
+            board.initialize_board_from_fen(fen);
+            cout << "\nRunning speed test for position (late_move_pruning=" << late_move_pruning << "):\n";
+            board.pretty_print_board();
+            uint64_t position_nodes = 0;
+            auto position_start     = chrono::high_resolution_clock::now();
+            engine::tt.clear();
+            engine::SearchContext context;
+            context.params.late_move_pruning = late_move_pruning;
+            engine::Searcher searcher(context);
+
+            cout << "\n Moves at depth 1 for color: " << moves::generate_all_moves_for_color(board, board.active_color).count + moves::generate_all_moves_for_color(board, !board.active_color).count << "\n";
+
+            for (int depth = 1; depth <= max_depth; depth++) {
+                auto depth_start    = chrono::high_resolution_clock::now();
+                auto best_move = searcher.get_best_move(board, depth, board.active_color);
+                auto depth_end      = chrono::high_resolution_clock::now();
+                auto depth_duration = chrono::duration_cast<chrono::milliseconds>(depth_end - depth_start);
+                position_nodes += best_move.second.nodes;
+
+                cout << "Depth " << depth << ": "
+                     << best_move.second.nodes << " nodes in "
+                     << depth_duration.count() << "ms"
+                     << "\n";
+            }
 
-            cout << "Depth " << depth << ": "
-                 << depth_duration.count() << "ms"
-                 << "\n";
+            auto position_end      = chrono::high_resolution_clock::now();
+            auto position_duration = chrono::duration_cast<chrono::milliseconds>(position_end - position_start);
+            cout << "\n------------> Total nodes: " << position_nodes << " (" << searcher.stats.qsearch_nodes
+                 << " in quiescence) in " << position_duration.count() << "ms\n";
+            const engine::SearchStats& stats = searcher.stats;
+            cout << "Pruned: " << stats.see_pruned << " SEE, " << stats.reverse_futility_pruned << " reverse futility, "
+                 << stats.futility_pruned << " futility, " << stats.razored << " razored, " << stats.probcut_cutoffs
+                 << " ProbCut, " << stats.late_move_pruned << " late moves, " << stats.history_pruned << " history\n";
         }
-
-        auto position_end      = chrono::high_resolution_clock::now();
-        auto position_duration = chrono::duration_cast<chrono::milliseconds>(position_end - position_start);
     }
 
     auto suite_end      = chrono::high_resolution_clock::now();
@@ -735,33 +1339,39 @@ void test_evaluation() {
     board.initialize_board_from_fen("8/8/8/8/8/8/8/8");
     assert(eval::evaluate_position(board) == 0);
 
-    // Single pieces on e4
+    // Single pieces on e4, alone on the board they are scored as in the endgame and reach every square of their kind
     board.initialize_board_from_fen("8/8/8/8/4P3/8/8/8");
-    assert(eval::evaluate_position(board) == eval::PAWN_VALUE + eval::PAWN_TABLE[35]);
+    // A lone pawn is passed and isolated at the same time
+    assert(eval::evaluate_position(board) == eval::PAWN_VALUE_EG + eval::PAWN_TABLE_EG[35] +
+                                                 eval::eg_value(eval::PASSED_PAWN[3] + eval::ISOLATED_PAWN));
 
     board.initialize_board_from_fen("8/8/8/8/4N3/8/8/8");
-    assert(eval::evaluate_position(board) == eval::KNIGHT_VALUE + eval::KNIGHT_TABLE[35]);
+    assert(eval::evaluate_position(board) == eval::KNIGHT_VALUE_EG + eval::KNIGHT_TABLE_EG[35] +
+                                                 eval::eg_value(eval::MOBILITY_BONUS[1]) * (8 - eval::MOBILITY_BASE[1]));
 
     board.initialize_board_from_fen("8/8/8/8/4B3/8/8/8");
-    assert(eval::evaluate_position(board) == eval::BISHOP_VALUE + eval::BISHOP_TABLE[35]);
+    assert(eval::evaluate_position(board) == eval::BISHOP_VALUE_EG + eval::BISHOP_TABLE_EG[35] +
+                                                 eval::eg_value(eval::MOBILITY_BONUS[2]) * (13 - eval::MOBILITY_BASE[2]));
 
     board.initialize_board_from_fen("8/8/8/8/4R3/8/8/8");
-    assert(eval::evaluate_position(board) == eval::ROOK_VALUE + eval::ROOK_TABLE[35]);
+    assert(eval::evaluate_position(board) == eval::ROOK_VALUE_EG + eval::ROOK_TABLE_EG[35] +
+                                                 eval::eg_value(eval::MOBILITY_BONUS[3]) * (14 - eval::MOBILITY_BASE[3]));
 
     board.initialize_board_from_fen("8/8/8/8/4Q3/8/8/8");
-    assert(eval::evaluate_position(board) == eval::QUEEN_VALUE + eval::QUEEN_TABLE[35]);
+    assert(eval::evaluate_position(board) == eval::QUEEN_VALUE_EG + eval::QUEEN_TABLE_EG[35] +
+                                                 eval::eg_value(eval::MOBILITY_BONUS[4]) * (27 - eval::MOBILITY_BASE[4]));
 
     board.initialize_board_from_fen("8/8/8/8/4K3/8/8/8");
-    assert(eval::evaluate_position(board) == eval::KING_VALUE + eval::KING_TABLE[35]);
+    assert(eval::evaluate_position(board) == eval::KING_VALUE + eval::KING_TABLE_EG[35]);
 
     // Black piece on 2nd rank gives same score as white piece on 7th rank
     board.initialize_board_from_fen("8/P7/8/8/8/8/8/8");
     int wps = eval::evaluate_position(board);
-    assert(wps == 150);
+    assert(wps == eval::PAWN_VALUE_EG + eval::PAWN_TABLE_EG[8] + eval::eg_value(eval::PASSED_PAWN[6] + eval::ISOLATED_PAWN));
 
     board.initialize_board_from_fen("8/8/8/8/8/8/p7/8");
     int bps = eval::evaluate_position(board);
-    assert(bps == -150);
+    assert(bps == -wps);
 
     // Test 2: Color symmetry
     board.initialize_board_from_fen("8/8/8/4P3/8/8/8/8");
@@ -800,14 +1410,472 @@ void test_evaluation() {
     int complex_score = eval::evaluate_position(board);
     assert(complex_score < 0); // Black should be slightly better (bishop + pawn vs knight + pawn)
 
+    // Test 5: Tapering
+    // Both halves survive packing, including negative ones
+    eval::ScorePair pair = eval::make_score(-37, 1200) - eval::make_score(400, -5);
+    assert(eval::mg_value(pair) == -437 && eval::eg_value(pair) == 1205);
+
+    // With all pieces on the board the king hides on g1, once they are gone it heads for the center
+    board.initialize_board_from_fen("rnbqkbnr/pppppppp/8/8/8/2NB1N2/PPPPPPPP/R1BQ1RK1 w kq - 0 1");
+    int castled = eval::evaluate_position(board);
+    board.initialize_board_from_fen("rnbqkbnr/pppppppp/8/8/4K3/2NB1N2/PPPPPPPP/R1BQ1R2 w kq - 0 1");
+    assert(eval::game_phase(board) == eval::PHASE_MAX);
+    assert(eval::evaluate_position(board) < castled);
+
+    board.initialize_board_from_fen("4k3/pppppppp/8/8/8/8/PPPPPPPP/6K1 w - - 0 1");
+    int cornered = eval::evaluate_position(board);
+    board.initialize_board_from_fen("4k3/pppppppp/8/8/4K3/8/PPPPPPPP/8 w - - 0 1");
+    assert(eval::game_phase(board) == 0);
+    assert(eval::evaluate_position(board) > cornered);
+
+    // Test 6: Pawn structure
+    // Doubled and isolated on the c-file, and with no black pawns around both are passed
+    board.initialize_board_from_fen("4k3/8/8/8/8/2P5/2P5/4K3 w - - 0 1");
+    assert(eval::evaluate_pawns(board).score ==
+           eval::DOUBLED_PAWN + 2 * eval::ISOLATED_PAWN + eval::PASSED_PAWN[1] + eval::PASSED_PAWN[2]);
+
+    // d3 is backward: e5 covers d4 and c4 is already past it. e5 is not, f6 can still come to its defense
+    board.initialize_board_from_fen("4k3/8/5p2/4p3/2P5/3P4/8/4K3 w - - 0 1");
+    assert(eval::evaluate_pawns(board).score == eval::BACKWARD_PAWN + eval::PASSED_PAWN[3] - eval::PASSED_PAWN[2]);
+
+    // ...and a passer that is worth more the further it got
+    board.initialize_board_from_fen("4k3/8/1P6/8/8/8/8/4K3 w - - 0 1");
+    assert(eval::evaluate_pawns(board).score == eval::PASSED_PAWN[5] + eval::ISOLATED_PAWN);
+    board.initialize_board_from_fen("4k3/8/8/8/8/8/1p6/4K3 w - - 0 1");
+    assert(eval::evaluate_pawns(board).score == -(eval::PASSED_PAWN[6] + eval::ISOLATED_PAWN));
+
+    // A castled king behind its pawns is sheltered, one that lost them is not
+    board.initialize_board_from_fen("4k3/8/8/8/8/8/5PPP/6K1 w - - 0 1");
+    assert(eval::evaluate_pawns(board).shield[0][6] == 3 * eval::SHIELD_CLOSE);
+    board.initialize_board_from_fen("4k3/8/8/8/8/7P/8/6K1 w - - 0 1");
+    assert(eval::evaluate_pawns(board).shield[0][6] == 2 * eval::SHIELD_MISSING + eval::SHIELD_FAR);
+
+    // Test 7: Piece activity
+    // The knight reaches all eight squares, but c5 is covered by the pawn on d6
+    board.initialize_board_from_fen("8/8/3p4/8/4N3/8/8/8");
+    assert(eval::eg_value(eval::evaluate_activity(board)) ==
+           eval::eg_value(eval::MOBILITY_BONUS[1]) * (7 - eval::MOBILITY_BASE[1]));
+
+    // The queen alone is no danger to the king, together with the knight it is
+    board.initialize_board_from_fen("6k1/5ppp/8/8/8/3Q4/8/6K1 w - - 0 1");
+    int queen_only = eval::mg_value(eval::evaluate_activity(board));
+    board.initialize_board_from_fen("6k1/5ppp/8/6N1/8/3Q4/8/6K1 w - - 0 1");
+    int queen_knight = eval::mg_value(eval::evaluate_activity(board));
+    assert(queen_knight - queen_only > eval::mg_value(eval::MOBILITY_BONUS[1]) * (8 - eval::MOBILITY_BASE[1]));
+
+    // Without pawns every square the knight attacks in our half is a hole, c2 and e2 can still cover b4 and f4
+    board.initialize_board_from_fen("4k3/8/8/3n4/8/8/8/4K3 w - - 0 1");
+    eval::ScorePair no_pawns = eval::evaluate_activity(board);
+    board.initialize_board_from_fen("4k3/8/8/3n4/8/8/2P1P3/4K3 w - - 0 1");
+    assert(eval::evaluate_activity(board) - no_pawns == -2 * eval::WEAK_SQUARE);
+
+    // Test 8: Material and known endgames
+    board.initialize_board_from_fen("r1bqk1nr/pppppppp/8/8/8/8/PPPPPPPP/R1BQKBNR w KQkq - 0 1");
+    eval::material_entry_t material = eval::evaluate_material(board.material_key);
+    assert(material.imbalance == eval::BISHOP_PAIR && material.phase == eval::game_phase(board) && !material.endgame);
+
+    // A lone minor or two knights can't mate
+    board.initialize_board_from_fen("4k3/8/8/8/8/8/8/2B1K3 w - - 0 1");
+    assert(eval::evaluate_position(board) == 0);
+    board.initialize_board_from_fen("4k3/8/8/8/8/8/8/1N2KN2 w - - 0 1");
+    assert(eval::evaluate_position(board) == 0);
+
+    // Two bishops only mate if they run on different colors, the material key alone does not know
+    board.initialize_board_from_fen("4k3/8/8/8/8/8/8/2B1KB2 w - - 0 1");
+    assert(eval::evaluate_position(board) > eval::KNOWN_WIN);
+    board.initialize_board_from_fen("4k3/8/8/8/8/4B3/8/2B1K3 w - - 0 1");
+    assert(eval::evaluate_position(board) == 0);
+    board.initialize_board_from_fen("2b1k3/8/4b3/8/8/8/8/4K3 w - - 0 1");
+    assert(eval::evaluate_position(board) == 0);
+
+    // A rook does, and the closer the king is to the edge the better
+    board.initialize_board_from_fen("7k/8/5K2/8/8/8/8/R7 w - - 0 1");
+    int cornered_king = eval::evaluate_position(board);
+    board.initialize_board_from_fen("8/8/8/3k4/8/5K2/8/R7 w - - 0 1");
+    assert(eval::evaluate_position(board) > eval::KNOWN_WIN && cornered_king > eval::evaluate_position(board));
+
+    // Bishop and knight mate in a corner of the bishop's color, c1 is dark like a1 and h8
+    board.initialize_board_from_fen("7k/8/6K1/8/8/8/8/2B1N3 w - - 0 1");
+    int right_corner = eval::evaluate_position(board);
+    board.initialize_board_from_fen("k7/8/1K6/8/8/8/8/2B1N3 w - - 0 1");
+    assert(eval::evaluate_position(board) > eval::KNOWN_WIN && right_corner > eval::evaluate_position(board));
+
+    // Rook against pawn: won with our king in front of the pawn, close with the pawn supported and our king far away
+    board.initialize_board_from_fen("8/8/8/8/8/8/1p5k/1K5R b - - 0 1");
+    assert(eval::evaluate_position(board) == eval::ROOK_VALUE_EG - 1);
+    board.initialize_board_from_fen("7K/8/8/8/8/2k5/1p6/7R w - - 0 1");
+    assert(eval::evaluate_position(board) == 80 - 8 * 6);
+    board.initialize_board_from_fen("7r/1P6/2K5/8/8/8/8/7k b - - 0 1");
+    assert(eval::evaluate_position(board) == -(80 - 8 * 6));
+
+    // Queen against rook is won, though not yet known to be
+    board.initialize_board_from_fen("3rk3/8/8/8/8/8/8/3QK3 w - - 0 1");
+    assert(eval::evaluate_position(board) > 0 && eval::evaluate_position(board) < eval::KNOWN_WIN);
+
+    // Test 9: Lazy evaluation
+    // A queen up, the estimate alone is clearly outside a window around equality, but not one around the real score
+    board.initialize_board_from_fen("r1b1kbnr/pppp1ppp/2n5/4p3/4P3/5N2/PPPP1PPP/RNBQKB1R w KQkq - 0 1");
+    int exact  = eval::evaluate_position(board);
+    int margin = eval::lazy_margin(eval::game_phase(board));
+    eval::eval_window_t window{-50, 50};
+    int estimate = eval::evaluate_position(board, nullptr, nullptr, &window);
+    assert(window.lazy_exit && estimate - margin >= window.beta);
+    assert(abs(estimate - exact) < margin);
+
+    window = {exact - 50, exact + 50};
+    assert(eval::evaluate_position(board, nullptr, nullptr, &window) == exact && !window.lazy_exit);
+
+    // The margin is measured, not a bound. Busy middlegames and endgames stay well within it
+    for (const string& fen : {"r4rk1/1pp1qppp/p1np1n2/2b1p1B1/2B1P1b1/P1NP1N2/1PP1QPPP/R4RK1 w - - 0 10"s,
+                              "2rr3k/pp3pp1/1nnqbN1p/3pN3/2pP4/2P3Q1/PPB4P/R4RK1 w - - 0 1"s,
+                              "3r2k1/p4ppp/1p2p3/2r5/2P5/1P3P2/P4KPP/3RR3 w - - 0 25"s}) {
+        board.initialize_board_from_fen(fen);
+        int phase = eval::game_phase(board);
+        assert(abs(eval::taper(eval::evaluate_activity(board), phase)) < eval::lazy_margin(phase));
+    }
+
     cout << "✓ Evaluation tests passed\n"
          << endl;
 }
 
+void test_nnue() {
+    // Random weights are enough to check the bookkeeping, the kernels have to agree on them and so do the incremental
+    // and the full accumulator updates
+    auto network = make_unique<nnue::network_t>();
+    mt19937 rng(42);
+    uniform_int_distribution<int> feature_weight(-64, 64), output_weight(-127, 127);
+    for (auto& row : network->feature_weights) {
+        for (int16_t& weight : row) {
+            weight = int16_t(feature_weight(rng));
+        }
+    }
+    for (int i = 0; i < nnue::HIDDEN_SIZE; i++) {
+        network->feature_bias[i]   = int16_t(feature_weight(rng));
+        network->output_weights[i] = int8_t(output_weight(rng));
+    }
+    network->output_bias = 1000;
+
+    string path = "/tmp/blueherring_test_network.bin";
+    string error;
+    assert(network->save(path));
+    auto loaded = make_unique<nnue::network_t>();
+    assert(loaded->load(path, error));
+    remove(path.c_str());
+
+    vector<nnue::SimdLevel> levels = {nnue::SimdLevel::SCALAR};
+    if (nnue::best_simd_level() != nnue::SimdLevel::SCALAR) {
+        levels.push_back(nnue::SimdLevel::SSE2);
+    }
+    if (nnue::best_simd_level() == nnue::SimdLevel::AVX2) {
+        levels.push_back(nnue::SimdLevel::AVX2);
+    }
+
+    // En passant, castling on both sides, a promotion and a capture of the promoted piece
+    bitboard_t board;
+    board.initialize_board_from_fen("r3k2r/1P6/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1");
+    vector<string> moves = {"e5d6", "e8g8", "b7b8q", "a8b8", "e1c1"};
+
+    nnue::accumulator_t parent, child, fresh;
+    loaded->refresh(board, parent);
+    for (const string& move_str : moves) {
+        bitboard_move_t move               = coordinate_move_to_bitboard_move(parse_move_from_string(move_str));
+        piece_t captured                   = moves::make_move(board, move);
+        nnue::feature_delta_t delta        = nnue::move_delta(board, move, captured);
+        int expected                       = 0;
+
+        for (nnue::SimdLevel level : levels) {
+            loaded->simd = level;
+            loaded->update(parent, delta, child);
+            loaded->refresh(board, fresh);
+            assert(memcmp(child.values, fresh.values, sizeof(child.values)) == 0);
+            if (level == nnue::SimdLevel::SCALAR) {
+                expected = loaded->evaluate(child);
+            }
+            assert(loaded->evaluate(child) == expected);
+        }
+        parent = child;
+    }
+
+    // And the search has to keep its accumulators in sync through every kind of move it makes
+    board.initialize_board_from_fen("r1bqkb1r/pppp1ppp/2n2n2/4p3/2B1P3/5N2/PPPP1PPP/RNBQK2R w KQkq - 4 4");
+    engine::SearchContext context;
+    context.time_manager.init_fixed(LONG_MAX);
+    context.network = loaded.get();
+    engine::Searcher searcher(context);
+    searcher.get_best_move(board, 4, Color::WHITE);
+    assert(searcher.stats.nodes > 0);
+
+    cout << "✓ NNUE test passed (" << levels.size() << " kernels)\n" << endl;
+}
+
+void test_move_gains() {
+    // Material plus square value of the whole board as a score pair, from white's side
+    auto pst_total = [](const bitboard_t& board) {
+        eval::ScorePair total = 0;
+        const U64 white[6]    = {board.board_w_P, board.board_w_N, board.board_w_B,
+                                 board.board_w_R, board.board_w_Q, board.board_w_K};
+        const U64 black[6]    = {board.board_b_P, board.board_b_N, board.board_b_B,
+                                 board.board_b_R, board.board_b_Q, board.board_b_K};
+        for (int type = 0; type < 6; type++) {
+            for (U64 b = white[type]; b; b &= b - 1) {
+                total += eval::PIECE_SQUARE_PAIRS.pairs[type][63 - __builtin_ctzll(b)];
+            }
+            for (U64 b = black[type]; b; b &= b - 1) {
+                total -= eval::PIECE_SQUARE_PAIRS.pairs[type][__builtin_ctzll(b)];
+            }
+        }
+        return total;
+    };
+
+    // Castling both ways, en passant, promotions with and without a capture, for both colors, and more moves than
+    // a multiple of eight so the kernel's tail is covered too
+    const vector<string> fens = {"rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1",
+                                 "r3k2r/1P6/8/3pP3/8/8/8/R3K2R w KQkq d6 0 1",
+                                 "r3k2r/8/8/8/3pP3/8/1p6/R3K2R b KQkq e3 0 1"};
+    int checked = 0;
+    for (const string& fen : fens) {
+        bitboard_t board;
+        board.initialize_board_from_fen(fen);
+        Color color          = board.active_color;
+        move_list_t move_list = moves::generate_all_moves_for_color(board, color);
+        eval::move_batch_t batch;
+        eval::prepare_move_batch(board, move_list, color, batch);
+
+        eval::Score scalar[MAX_MOVES];
+        int phase = eval::game_phase(board);
+        eval::move_gains_scalar(batch, phase, scalar);
+        eval::ScorePair before = pst_total(board);
+        for (int i = 0; i < move_list.count; i++) {
+            piece_t captured     = moves::make_move(board, move_list.moves[i]);
+            eval::ScorePair gain = pst_total(board) - before;
+            moves::undo_move(board, move_list.moves[i], captured);
+            assert(scalar[i] == eval::taper(color == Color::WHITE ? gain : -gain, phase));
+        }
+
+#ifdef EVAL_X86
+        if (__builtin_cpu_supports("avx2")) {
+            eval::Score simd[MAX_MOVES];
+            for (int p = 0; p <= eval::PHASE_MAX; p++) {
+                eval::move_gains_scalar(batch, p, scalar);
+                eval::move_gains_avx2(batch, p, simd);
+                assert(memcmp(scalar, simd, move_list.count * sizeof(eval::Score)) == 0);
+            }
+        }
+#endif
+        checked += move_list.count;
+    }
+
+    cout << "✓ Move gain test passed (" << checked << " moves)\n" << endl;
+}
+
+void test_eval_cache() {
+    eval_cache_t cache(1);
+    int score = 0;
+    U64 key   = 0x123456789abcdef0ULL;
+    assert(!cache.probe(key, score));
+
+    cache.store(key, -1234);
+    assert(cache.probe(key, score) && score == -1234);
+
+    // Same slot, different key: the verification bits tell them apart
+    U64 other = key ^ 0x8000000000000000ULL;
+    assert(!cache.probe(other, score));
+    cache.store(other, 77);
+    assert(cache.probe(other, score) && score == 77);
+    assert(!cache.probe(key, score));
+
+    cache.resize(0);
+    assert(!cache.enabled());
+
+    cout << "✓ Eval cache test passed\n" << endl;
+}
+
+void test_kpk() {
+    bitboard_t board;
+    auto kpk_result = [&](const string& fen) {
+        board.initialize_board_from_fen(fen);
+        return eval::evaluate_position(board);
+    };
+
+    // The king on the sixth in front of its pawn wins whoever is to move
+    assert(kpk_result("4k3/8/4K3/4P3/8/8/8/8 w - - 0 1") > eval::KNOWN_WIN);
+    assert(kpk_result("4k3/8/4K3/4P3/8/8/8/8 b - - 0 1") > eval::KNOWN_WIN);
+
+    // Two squares in front of the pawn it only wins with the opposition
+    assert(kpk_result("8/4k3/8/4K3/4P3/8/8/8 w - - 0 1") == 0);
+    assert(kpk_result("8/4k3/8/4K3/4P3/8/8/8 b - - 0 1") > eval::KNOWN_WIN);
+
+    // A rook pawn with the defending king in the corner never wins, on the h-file like on the a-file
+    assert(kpk_result("k7/8/1K6/P7/8/8/8/8 b - - 0 1") == 0);
+    assert(kpk_result("7k/8/6K1/7P/8/8/8/8 b - - 0 1") == 0);
+
+    // Outside the square of the pawn the king can't catch it, inside it reaches the corner in time
+    assert(kpk_result("7k/8/8/8/8/8/P7/K7 w - - 0 1") > eval::KNOWN_WIN);
+    assert(kpk_result("3k4/8/8/8/8/8/P7/K7 w - - 0 1") == 0);
+
+    // The same for black
+    assert(kpk_result("8/8/8/8/4p3/4k3/8/4K3 w - - 0 1") < -eval::KNOWN_WIN);
+    assert(kpk_result("8/8/8/4k3/8/8/4P3/4K3 w - - 0 1") == 0);
+
+    cout << "✓ KPK bitbase test passed\n" << endl;
+}
+
+void test_syzygy() {
+    assert(syzygy::INDEX.kk_placements == 462);
+
+    // Decoding: a Huffman code with lengths 1 to 3 (symbol 3 = "1", 2 = "01", 0 = "000", 1 = "001"), where symbol 3
+    // is a pair that expands to symbols 2 and 1. The blocks are filled with random symbols and every index has to
+    // decode to the value that was encoded there
+    const int leaf_values[3] = {0, 4, 2};
+    const int code_bits[4]   = {0b000, 0b001, 0b01, 0b1};
+    const int code_length[4] = {3, 3, 2, 1};
+    mt19937 rng(7);
+    vector<int> values;
+    vector<uint8_t> blocks;
+    vector<int> block_start, block_count;
+    U64 bits = 0;
+    int used = 0;
+    auto flush_block = [&]() {
+        for (int i = 7; i >= 0; i--) {
+            blocks.push_back(uint8_t((bits << (64 - used)) >> (8 * i)));
+        }
+        bits = 0;
+        used = 0;
+    };
+    for (int i = 0; i < 300; i++) {
+        int symbol = int(rng() % 4);
+        if (used + code_length[symbol] > 64) {
+            flush_block();
+        }
+        if (used == 0) {
+            block_start.push_back(int(values.size()));
+            block_count.push_back(0);
+        }
+        bits = (bits << code_length[symbol]) | U64(code_bits[symbol]);
+        used += code_length[symbol];
+        if (symbol == 3) {
+            values.push_back(leaf_values[2]);
+            values.push_back(leaf_values[1]);
+            block_count.back() += 2;
+        } else {
+            values.push_back(leaf_values[symbol]);
+            block_count.back()++;
+        }
+    }
+    flush_block();
+    blocks.resize(blocks.size() + 8); // the decoder reads ahead
+
+    auto le16 = [](vector<uint8_t>& out, int value) {
+        out.push_back(uint8_t(value));
+        out.push_back(uint8_t(value >> 8));
+    };
+    auto tree_node = [](vector<uint8_t>& out, int left, int right) {
+        out.push_back(uint8_t(left));
+        out.push_back(uint8_t(((left >> 8) & 0xF) | ((right & 0xF) << 4)));
+        out.push_back(uint8_t(right >> 4));
+    };
+    int block_count_total = int(block_start.size());
+    vector<uint8_t> header = {0, 3, 4, 0, uint8_t(block_count_total), 0, 0, 0, 3, 1};
+    le16(header, 3); // lowest symbol of each code length, 1 to 3
+    le16(header, 2);
+    le16(header, 0);
+    le16(header, 4);
+    tree_node(header, leaf_values[0], 0xFFF);
+    tree_node(header, leaf_values[1], 0xFFF);
+    tree_node(header, leaf_values[2], 0xFFF);
+    tree_node(header, 2, 1);
+
+    syzygy::pairs_data_t pairs;
+    pairs.group_idx[0] = values.size();
+    assert(syzygy::set_sizes(pairs, header.data()) == header.data() + header.size());
+
+    vector<uint8_t> sparse, lengths;
+    for (size_t k = 0; k < pairs.sparse_count; k++) {
+        int target = int(k * pairs.span + pairs.span / 2);
+        int block  = 0;
+        while (block + 1 < block_count_total && block_start[block + 1] <= target) {
+            block++;
+        }
+        uint32_t first = uint32_t(block);
+        sparse.insert(sparse.end(), {uint8_t(first), uint8_t(first >> 8), uint8_t(first >> 16), uint8_t(first >> 24)});
+        le16(sparse, target - block_start[block]);
+    }
+    for (int count : block_count) {
+        le16(lengths, count - 1);
+    }
+    pairs.sparse_index = sparse.data();
+    pairs.block_length = lengths.data();
+    pairs.data         = blocks.data();
+    for (size_t idx = 0; idx < values.size(); idx++) {
+        assert(syzygy::decompress_pairs(pairs, idx) == values[idx]);
+    }
+
+    // Probing: KRvK tables that hold a single value per side to move, which still goes through the file parsing, the
+    // lookup by material with the colors swapped, the capture search and the root move choice
+    string directory = "/tmp/blueherring_test_syzygy";
+    mkdir(directory.c_str(), 0755);
+    auto write_table = [&](const string& name, vector<uint8_t> bytes) {
+        bytes.resize(80); // 64n + 16 bytes, like every real table
+        FILE* file = fopen((directory + "/" + name).c_str(), "wb");
+        assert(file != nullptr);
+        fwrite(bytes.data(), 1, bytes.size(), file);
+        fclose(file);
+    };
+    // magic, not symmetric, leading group order, pieces (white king, black king, white rook), then per side to move
+    // a single value: the rook side wins (4) with white to move and loses (0) with black to move
+    write_table("KRvK.rtbw", {0x71, 0xE8, 0x23, 0x5D, 0x01, 0x00, 0x66, 0xEE, 0x44, 0x00, 0x80, 4, 0x80, 0});
+    // DTZ for white to move only, 3 moves
+    write_table("KRvK.rtbz", {0xD7, 0x66, 0x0C, 0xA5, 0x01, 0x00, 0x06, 0x0E, 0x04, 0x00, 0x80, 3});
+
+    syzygy::tablebases_t tablebases;
+    assert(tablebases.init(directory) == 1 && tablebases.max_pieces == 3);
+
+    bitboard_t board;
+    syzygy::probe_state_t state;
+    auto wdl = [&](const string& fen) {
+        board.initialize_board_from_fen(fen);
+        syzygy::wdl_t result = tablebases.probe_wdl(board, state);
+        return state == syzygy::FAIL ? -100 : int(result);
+    };
+    assert(wdl("8/8/8/8/8/2k5/8/R3K3 w - - 0 1") == syzygy::WIN);
+    assert(wdl("8/8/8/8/8/2k5/8/R3K3 b - - 0 1") == syzygy::LOSS);
+    assert(wdl("4k3/8/8/8/8/8/2K5/r7 b - - 0 1") == syzygy::WIN);  // black has the rook
+    assert(wdl("8/8/8/8/8/8/1kR5/4K3 b - - 0 1") == syzygy::DRAW); // the rook hangs
+    assert(wdl("8/8/8/8/8/2k5/8/Q3K3 w - - 0 1") == -100);         // no KQvK table
+
+    board.initialize_board_from_fen("8/8/8/8/8/2k5/8/R3K3 b - - 0 1");
+    assert(tablebases.probe_dtz(board, state) == -8 && state != syzygy::FAIL);
+    board.initialize_board_from_fen("r3k3/8/8/8/8/8/8/4K3 w q - 0 1");
+    assert(!tablebases.can_probe(board)); // castling rights
+
+    // At the root the hanging rook has to be saved
+    board.initialize_board_from_fen("8/8/8/8/8/8/1kR5/4K3 w - - 0 1");
+    engine::SearchContext context;
+    context.time_manager.init_fixed(LONG_MAX);
+    context.tablebases = &tablebases;
+    engine::Searcher searcher(context);
+    engine::RootResult result = searcher.search(board, Color::WHITE);
+    assert(result.score == engine::TB_WIN_SCORE);
+    piece_t captured = moves::make_move(board, result.best_move);
+    assert(tablebases.probe_wdl(board, state) == syzygy::LOSS);
+    moves::undo_move(board, result.best_move, captured);
+
+    remove((directory + "/KRvK.rtbw").c_str());
+    remove((directory + "/KRvK.rtbz").c_str());
+    rmdir(directory.c_str());
+
+    cout << "✓ Syzygy test passed\n" << endl;
+}
+
 void run_eval_test_suite() {
     cout << "\nRunning evaluation tests...\n"
          << endl;
     test_evaluation();
+    test_move_gains();
+    test_eval_cache();
+    test_kpk();
+    test_syzygy();
+    test_nnue();
 }
 
 } // namespace tests
@@ -0,0 +1,72 @@
+#ifndef timeman_hpp
+#define timeman_hpp
+
+#include <algorithm>
+
+using namespace std;
+
+namespace timeman {
+
+constexpr long MOVE_OVERHEAD       = 100;  // ms lost to starting the process, file IO and network lag every move
+constexpr int MOVES_TO_GO_MAX      = 50;   // assumed number of moves left at the start of the game...
+constexpr int MOVES_TO_GO_MIN      = 20;   // ...and the least we ever plan for
+constexpr double INCREMENT_SHARE   = 0.75; // part of the increment we spend right away
+constexpr double MAXIMUM_FACTOR    = 5.0;  // the hard limit may be this many times the optimum...
+constexpr double MAXIMUM_SHARE     = 0.8;  // ...but never more than this share of the clock
+constexpr long MINIMUM_TIME        = 10;   // ms, always search at least a little
+constexpr double UNSTABLE_SCALE    = 1.8;  // soft limit scale right after the best move changed
+constexpr double STABLE_SCALE_STEP = 0.1;  // soft limit shrinks this much for every iteration with the same move
+constexpr double STABLE_SCALE_MIN  = 0.5;
+
+// Decides how long to think about a move. The optimum is what we would like to spend, the maximum is a hard deadline.
+// Between iterations the search asks can_start_iteration(), which compares against a soft limit: the optimum, scaled
+// up while the best move keeps changing and down while it stays the same. Only the maximum aborts a running iteration.
+struct time_manager_t {
+    bool has_clock  = false;
+    long optimum_ms = 0;
+    long maximum_ms = 0;
+    double scale    = 1.0;
+
+    // Without a clock every move gets the same fixed time, and we might as well use all of it
+    void init_fixed(long move_time_ms) {
+        has_clock  = false;
+        optimum_ms = move_time_ms;
+        maximum_ms = move_time_ms;
+    }
+
+    void init(long remaining_ms, long increment_ms, int ply) {
+        has_clock = true;
+        scale     = 1.0;
+
+        long available  = max(remaining_ms - MOVE_OVERHEAD, MINIMUM_TIME);
+        int moves_to_go = clamp(MOVES_TO_GO_MAX - ply / 4, MOVES_TO_GO_MIN, MOVES_TO_GO_MAX);
+
+        optimum_ms = long(available / moves_to_go + increment_ms * INCREMENT_SHARE);
+        maximum_ms = long(min(optimum_ms * MAXIMUM_FACTOR, available * MAXIMUM_SHARE));
+        maximum_ms = max(maximum_ms, MINIMUM_TIME);
+        optimum_ms = clamp(optimum_ms, MINIMUM_TIME, maximum_ms);
+    }
+
+    void on_iteration_done(bool best_move_changed) {
+        if (best_move_changed) {
+            scale = UNSTABLE_SCALE;
+        } else {
+            scale = max(STABLE_SCALE_MIN, scale - STABLE_SCALE_STEP);
+        }
+    }
+
+    long soft_limit() const {
+        if (!has_clock) {
+            return maximum_ms;
+        }
+        return min(long(optimum_ms * scale), maximum_ms);
+    }
+
+    bool can_start_iteration(long elapsed_ms) const {
+        return elapsed_ms < soft_limit();
+    }
+};
+
+} // namespace timeman
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef tt_hpp
+#define tt_hpp
+
+#include "move_t.hpp"
+#include <atomic>
+#include <memory>
+
+enum class Bound {
+    NONE,
+    EXACT, // the score is the true score of the position
+    LOWER, // the search failed high, the true score is at least this
+    UPPER  // the search failed low, the true score is at most this
+};
+
+struct tt_entry_t {
+    int score;
+    int depth;
+    Bound bound;
+    bitboard_move_t best_move;
+};
+
+// Transposition table shared by all search threads. Entries are not locked, instead every slot stores the key XOR'ed
+// with the data. If two threads write the same slot at the same time, the key and data no longer match up and the
+// torn entry is simply treated as a miss.
+class transposition_table_t {
+  private:
+    friend struct TranspositionTableInspector;
+
+    struct slot_t {
+        std::atomic<U64> key_xor_data{0};
+        std::atomic<U64> data{0};
+    };
+
+    std::unique_ptr<slot_t[]> slots;
+    U64 mask; // number of slots - 1, the size is always a power of two
+
+    // Layout of the data word (LSB first): score 32 bits | depth 8 | bound 2 | from 6 | to 6 | promotion 3
+    static U64 pack(const tt_entry_t& entry) {
+        U64 data = U64(uint32_t(entry.score));
+        data |= U64(entry.depth & 0xFF) << 32;
+        data |= U64(entry.bound) << 40;
+        if (entry.best_move.from_board) {
+            data |= U64(__builtin_ctzll(entry.best_move.from_board)) << 42;
+            data |= U64(__builtin_ctzll(entry.best_move.to_board)) << 48;
+            data |= U64(entry.best_move.promotion_type) << 54;
+        }
+        return data;
+    }
+
+    static tt_entry_t unpack(U64 data) {
+        tt_entry_t entry;
+        entry.score = int(uint32_t(data & 0xFFFFFFFF));
+        entry.depth = int((data >> 32) & 0xFF);
+        entry.bound = Bound((data >> 40) & 0x3);
+
+        int from_idx = int((data >> 42) & 0x3F);
+        int to_idx   = int((data >> 48) & 0x3F);
+        if (from_idx != to_idx) { // from == to only happens when no move was stored
+            entry.best_move = bitboard_move_t(1ULL << from_idx, 1ULL << to_idx, PieceType((data >> 54) & 0x7));
+        }
+        return entry;
+    }
+
+  public:
+    explicit transposition_table_t(size_t size_mb) {
+        size_t count = 1;
+        while (count * 2 * sizeof(slot_t) <= size_mb * 1024 * 1024) {
+            count *= 2;
+        }
+        slots = std::make_unique<slot_t[]>(count);
+        mask  = count - 1;
+    }
+
+    bool probe(U64 key, tt_entry_t& entry) const {
+        const slot_t& slot = slots[key & mask];
+        U64 data           = slot.data.load(std::memory_order_relaxed);
+        U64 key_xor_data   = slot.key_xor_data.load(std::memory_order_relaxed);
+
+        if ((key_xor_data ^ data) != key || data == 0) {
+            return false;
+        }
+        entry = unpack(data);
+        return true;
+    }
+
+    void store(U64 key, const tt_entry_t& entry) {
+        slot_t& slot = slots[key & mask];
+
+        // Keep deeper results for the same position, anything else is simply overwritten
+        U64 old_data = slot.data.load(std::memory_order_relaxed);
+        if ((slot.key_xor_data.load(std::memory_order_relaxed) ^ old_data) == key &&
+            unpack(old_data).depth > entry.depth) {
+            return;
+        }
+
+        U64 data = pack(entry);
+        slot.data.store(data, std::memory_order_relaxed);
+        slot.key_xor_data.store(key ^ data, std::memory_order_relaxed);
+    }
+
+    void clear() {
+        for (U64 i = 0; i <= mask; i++) {
+            slots[i].data.store(0, std::memory_order_relaxed);
+            slots[i].key_xor_data.store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+// ---- FOR TESTING ----
+
+// The slots are private to the table, the tests reach them through here
+struct TranspositionTableInspector {
+    // Leaves the slot of key the way two racing writers can: the check word of the first write with the data of the
+    // second
+    static void tear(transposition_table_t& table, U64 key, const tt_entry_t& first, const tt_entry_t& second) {
+        auto& slot = table.slots[key & table.mask];
+        slot.key_xor_data.store(key ^ transposition_table_t::pack(first), std::memory_order_relaxed);
+        slot.data.store(transposition_table_t::pack(second), std::memory_order_relaxed);
+    }
+
+    // Calls visit on every slot that was ever written
+    template <typename Visitor> static void for_each_entry(const transposition_table_t& table, Visitor visit) {
+        for (U64 i = 0; i <= table.mask; i++) {
+            U64 data = table.slots[i].data.load(std::memory_order_relaxed);
+            if (data != 0) {
+                visit(transposition_table_t::unpack(data));
+            }
+        }
+    }
+};
+
+#endif